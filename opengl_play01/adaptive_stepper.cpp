@@ -0,0 +1,195 @@
+#include "adaptive_stepper.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Largest eigenvalue of the symmetric 3x3 matrix with diagonal d and
+// off-diagonal o = (xy, xz, yz), in closed form.
+static float max_eigenvalue(const Vec3f& d, const Vec3f& o) {
+    float p1 = o.x * o.x + o.y * o.y + o.z * o.z;
+    if (p1 == 0.0f) {
+        return std::max(d.x, std::max(d.y, d.z));
+    }
+
+    float q = (d.x + d.y + d.z) / 3.0f;
+    Vec3f e(d.x - q, d.y - q, d.z - q);
+    float p = sqrtf((e.dot(e) + 2.0f * p1) / 6.0f);
+    float det = e.x * (e.y * e.z - o.z * o.z) - o.x * (o.x * e.z - o.z * o.y) +
+        o.y * (o.x * o.z - e.y * o.y);
+    float r = std::min(std::max(det / (2.0f * p * p * p), -1.0f), 1.0f);
+    return q + 2.0f * p * cosf(acosf(r) / 3.0f);
+}
+
+// Largest eigenvalue of any free node's summed spring stiffness matrices,
+// and along the way the lightest moving node and the largest spring strain.
+// std::max() drops a NaN, so finite is cleared separately when any strain
+// or stiffness is not finite.
+static float max_node_stiffness(const SpringTopology& topology, const PinSet& pins,
+    const Vec4f* positions, float& min_mass, float& max_strain, bool& finite) {
+
+    float max_stiffness = 0.0f;
+    min_mass = FLT_MAX;
+    max_strain = 0.0f;
+    finite = true;
+
+    // Pinned nodes are never integrated
+    for (const NodeSpan& span : pins.free_spans) {
+        for (int n = span.begin; n < span.end; n++) {
+            // Sum of the node's spring stiffness matrices: k along the spring,
+            // plus k (1 - L / x) across it once stretched.
+            const Vec4f& p = positions[n];
+            Vec3f diagonal(0, 0, 0);
+            Vec3f off_diagonal(0, 0, 0);
+            for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+                const Vec4f& q = positions[topology.neighbours[s]];
+                Vec3f d(q.x - p.x, q.y - p.y, q.z - p.z);
+                float x = d.length();
+                float k = topology.coeffs[s].stiffness;
+                float rest_length = topology.coeffs[s].rest_length;
+                float k_across = k * std::max(1.0f - rest_length / x, 0.0f);
+                float strain = (x - rest_length) / rest_length;
+                finite = finite && std::isfinite(strain);
+                max_strain = std::max(max_strain, strain);
+                d = d / x;
+
+                diagonal += Vec3f(d.x * d.x, d.y * d.y, d.z * d.z) * (k - k_across) +
+                    Vec3f(k_across, k_across, k_across);
+                off_diagonal += Vec3f(d.x * d.y, d.x * d.z, d.y * d.z) * (k - k_across);
+            }
+
+            float stiffness = max_eigenvalue(diagonal, off_diagonal);
+            finite = finite && std::isfinite(stiffness);
+            max_stiffness = std::max(max_stiffness, stiffness);
+            min_mass = std::min(min_mass, p.w);
+        }
+    }
+
+    return max_stiffness;
+}
+
+static float step_bound(float max_stiffness, float min_mass, float c) {
+    // The whole system's stiffest mode is at most twice the stiffest node.
+    max_stiffness *= 2.0f;
+
+    if (!(max_stiffness > 0.0f)) {
+        return max_stiffness == 0.0f ? FLT_MAX : 0.0f;
+    }
+
+    // Undamped, the integrator gains energy at any t; keep well inside the
+    // stiffest mode's period instead.
+    if (c <= 0.0f) {
+        return 0.5f / sqrtf(max_stiffness / min_mass);
+    }
+
+    return std::min(2.0f * c / max_stiffness, 2.0f * min_mass / c);
+}
+
+float stable_step_bound(const SpringTopology& topology, const PinSet& pins,
+    const Vec4f* positions, float c) {
+
+    float min_mass, max_strain;
+    bool finite;
+    float max_stiffness = max_node_stiffness(topology, pins, positions, min_mass, max_strain, finite);
+    return finite ? step_bound(max_stiffness, min_mass, c) : 0.0f;
+}
+
+AdaptiveStepper::AdaptiveStepper()
+    : m_topology(nullptr), m_pins(nullptr), m_c(0), m_stable_step(0), m_shortest_rest_length(0),
+      m_frames(0), m_substeps_run(0), m_fewest_substeps(0), m_most_substeps(0),
+      m_capped_frames(0) {
+    m_indicators.max_speed = 0;
+    m_indicators.max_strain = 0;
+}
+
+void AdaptiveStepper::start(const SpringTopology& topology, const PinSet& pins,
+    const Vec4f* positions, float c, const AdaptiveStepLimits& limits) {
+
+    m_topology = &topology;
+    m_pins = &pins;
+    m_limits = limits;
+    m_c = c;
+    m_stable_step = stable_step_bound(topology, pins, positions, c);
+
+    m_shortest_rest_length = FLT_MAX;
+    for (const SpringCoeffs& spring : topology.coeffs) {
+        m_shortest_rest_length = std::min(m_shortest_rest_length, spring.rest_length);
+    }
+
+    m_previous.assign(positions, positions + topology.nodes());
+    m_indicators.max_speed = 0;
+    m_indicators.max_strain = 0;
+
+    m_frames = 0;
+    m_substeps_run = 0;
+    m_fewest_substeps = 0;
+    m_most_substeps = 0;
+    m_capped_frames = 0;
+}
+
+int AdaptiveStepper::substeps(float frame_time) {
+    float t = m_limits.safety * m_stable_step;
+
+    if (m_indicators.max_speed > 0.0f) {
+        t = std::min(t, m_limits.max_displacement * m_shortest_rest_length / m_indicators.max_speed);
+    }
+    if (m_indicators.max_strain > m_limits.max_strain) {
+        t *= m_limits.max_strain / m_indicators.max_strain;
+    }
+
+    // Clamped before converting: a tiny or zero t overflows an int, and
+    // a NaN one compares false.
+    float wanted = t > 0.0f ? ceilf(frame_time / t) : FLT_MAX;
+    int n;
+    if (wanted <= (float)m_limits.max_substeps) {
+        n = std::max((int)wanted, m_limits.min_substeps);
+    }
+    else {
+        n = m_limits.max_substeps;
+        m_capped_frames++;
+    }
+
+    m_fewest_substeps = m_frames ? std::min(m_fewest_substeps, n) : n;
+    m_most_substeps = std::max(m_most_substeps, n);
+    m_frames++;
+    m_substeps_run += n;
+    return n;
+}
+
+void AdaptiveStepper::observe(const Vec4f* positions, float frame_time) {
+    const SpringTopology& topology = *m_topology;
+    float max_distance_sq = 0.0f;
+    bool moved_finite = true;
+
+    for (int n = 0; n < topology.nodes(); n++) {
+        const Vec4f& p = positions[n];
+        Vec3f moved(p.x - m_previous[n].x, p.y - m_previous[n].y, p.z - m_previous[n].z);
+        float distance_sq = moved.dot(moved);
+        moved_finite = moved_finite && std::isfinite(distance_sq);
+        max_distance_sq = std::max(max_distance_sq, distance_sq);
+    }
+
+    float min_mass, max_strain;
+    bool finite;
+    float max_stiffness = max_node_stiffness(topology, *m_pins, positions, min_mass, max_strain, finite);
+    m_stable_step = step_bound(max_stiffness, min_mass, m_c);
+
+    // A blown-up state gets the smallest steps rather than carrying on as
+    // if calm.
+    if (!finite || !moved_finite) {
+        m_stable_step = 0.0f;
+        max_distance_sq = FLT_MAX;
+        max_strain = FLT_MAX;
+    }
+
+    m_indicators.max_speed = sqrtf(max_distance_sq) / frame_time;
+    m_indicators.max_strain = max_strain;
+    m_previous.assign(positions, positions + topology.nodes());
+}
+
+void AdaptiveStepper::print_stats(std::ostream& out, int fixed_substeps) const {
+    long long fixed = m_frames * fixed_substeps;
+    out << m_substeps_run << " substeps over " << m_frames << " frames (" <<
+        m_fewest_substeps << "-" << m_most_substeps << " per frame, " <<
+        m_capped_frames << " capped) vs " << fixed << " at " << fixed_substeps << "/frame (" <<
+        (fixed ? 100.0 * (m_substeps_run - fixed) / fixed : 0.0) << "%)" << std::endl;
+}
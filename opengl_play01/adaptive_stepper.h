@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+
+#include <ostream>
+#include <vector>
+
+#include "pin_set.h"
+#include "spring_topology.h"
+#include "vec_stuff.h"
+
+// Bounds on what AdaptiveStepper may choose.
+struct AdaptiveStepLimits {
+    int min_substeps;
+    int max_substeps;
+    // Fraction of the linear stability bound to step at.
+    float safety;
+    // Furthest a node may move in one substep, as a fraction of the
+    // shortest rest length.
+    float max_displacement;
+    // Springs stretched past this strain shrink the step in proportion.
+    float max_strain;
+
+    AdaptiveStepLimits()
+        : min_substeps(1), max_substeps(64), safety(0.9f), max_displacement(0.25f),
+          max_strain(0.5f) {
+    }
+};
+
+// What the last frame looked like.
+struct StepIndicators {
+    // Fastest node, from its displacement over the frame.
+    float max_speed;
+    // Largest (x - rest_length) / rest_length over all springs.
+    float max_strain;
+};
+
+// Largest t the update pass is stable at for the cloth in this pose, from
+// a linear analysis of its integrator: with damping c it holds while
+// t < 2c / K and t < 2m / c, K being the stiffest mode of the linearized
+// springs. K is bounded by twice the largest eigenvalue of any one
+// free node's summed spring stiffness matrices. 0 for a pose that isn't
+// finite.
+float stable_step_bound(const SpringTopology& topology, const PinSet& pins,
+    const Vec4f* positions, float c);
+
+// Picks how many substeps each frame gets from the stability bound and
+// the previous frame's speed and strain, all re-measured every frame, so
+// calm frames take big steps and violent ones small. Used once per frame:
+//
+//     int n = stepper.substeps(frame_time);
+//     params.t = frame_time / n;  ... step n times ...
+//     stepper.observe(positions, frame_time);
+class AdaptiveStepper {
+public:
+    AdaptiveStepper();
+
+    // positions is the starting state, in the topology's node order.
+    // topology and pins are kept by reference and must outlive the
+    // stepper's use.
+    void start(const SpringTopology& topology, const PinSet& pins,
+        const Vec4f* positions, float c, const AdaptiveStepLimits& limits);
+
+    int substeps(float frame_time);
+    void observe(const Vec4f* positions, float frame_time);
+
+    float stable_step() const { return m_stable_step; }
+    const StepIndicators& indicators() const { return m_indicators; }
+
+    long long frames() const { return m_frames; }
+    long long substeps_run() const { return m_substeps_run; }
+    int fewest_substeps() const { return m_fewest_substeps; }
+    int most_substeps() const { return m_most_substeps; }
+    // Frames that wanted more than max_substeps.
+    long long capped_frames() const { return m_capped_frames; }
+
+    // Reports the substeps run against fixed_substeps every frame.
+    void print_stats(std::ostream& out, int fixed_substeps) const;
+
+private:
+    const SpringTopology* m_topology;
+    const PinSet* m_pins;
+    AdaptiveStepLimits m_limits;
+    float m_c;
+    float m_stable_step;
+    float m_shortest_rest_length;
+
+    std::vector<Vec4f> m_previous;
+    StepIndicators m_indicators;
+
+    long long m_frames;
+    long long m_substeps_run;
+    int m_fewest_substeps;
+    int m_most_substeps;
+    long long m_capped_frames;
+};
@@ -0,0 +1,1323 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "adaptive_stepper.h"
+#include "implicit_solver.h"
+#include "matrix_math.h"
+#include "node_ordering.h"
+#include "soa_spring_solver.h"
+#include "spring_mass_solver.h"
+#include "trajectory_recorder.h"
+#include "xpbd_solver.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+struct GridSize {
+    int x;
+    int y;
+};
+
+static const GridSize default_bench_grids[] = {
+    { 50, 50 },
+    { 256, 256 },
+    { 1024, 1024 },
+    { 2048, 2048 },
+};
+
+// Grids the benchmarks run on; --grid narrows this to one size.
+static std::vector<GridSize> bench_grids(
+    default_bench_grids, default_bench_grids + sizeof(default_bench_grids) / sizeof(default_bench_grids[0]));
+
+static const double min_bench_seconds = 0.5;
+
+// Steps the solver in batches until at least min_bench_seconds have passed
+// and returns the number of node updates per second.
+template <typename StepFunc>
+static double measure_node_updates(int points_total, StepFunc step) {
+    const int batch = 4;
+
+    step(batch);
+
+    long long iterations = 0;
+    bench_clock::time_point start = bench_clock::now();
+    double elapsed;
+    do {
+        step(batch);
+        iterations += batch;
+        elapsed = seconds_since(start);
+    } while (elapsed < min_bench_seconds);
+
+    return (double)iterations * points_total / elapsed;
+}
+
+static void bench_solver() {
+    std::cout << "solver: scalar reference" << std::endl;
+
+    for (const GridSize& grid : bench_grids) {
+        SpringMassSolver solver(grid.x, grid.y);
+        double rate = measure_node_updates(solver.points_total(),
+            [&](int n) { solver.step(n); });
+
+        std::cout << "  " << grid.x << "x" << grid.y << ": "
+            << rate / 1e6 << " M node-updates/s" << std::endl;
+    }
+}
+
+// Largest position difference between the SoA kernel at level and the
+// reference solver after the number of steps SOA_KERNEL_TOLERANCE is
+// specified for.
+static float soa_max_error(SimdLevel level, const SpringParams& params = SpringParams()) {
+    const int steps = 64;
+
+    SpringMassSolver reference(50, 50);
+    SoaSpringSolver solver(50, 50, level);
+    reference.params() = params;
+    reference.reset();
+    solver.params() = params;
+    solver.reset();
+    reference.step(steps);
+    solver.step(steps);
+
+    std::vector<Vec4f> positions(solver.points_total());
+    std::vector<Vec3f> velocities(solver.points_total());
+    solver.read_back(positions.data(), velocities.data());
+
+    float max_error = 0.0f;
+    for (int n = 0; n < solver.points_total(); n++) {
+        const Vec4f& a = reference.positions()[n];
+        const Vec4f& b = positions[n];
+        max_error = std::max(max_error, std::fabs(a.x - b.x));
+        max_error = std::max(max_error, std::fabs(a.y - b.y));
+        max_error = std::max(max_error, std::fabs(a.z - b.z));
+    }
+    return max_error;
+}
+
+static void bench_soa() {
+    SimdLevel best = detect_simd_level();
+
+    std::vector<double> reference_rates;
+    for (const GridSize& grid : bench_grids) {
+        SpringMassSolver solver(grid.x, grid.y);
+        reference_rates.push_back(measure_node_updates(solver.points_total(),
+            [&](int n) { solver.step(n); }));
+    }
+
+    for (int level = SIMD_SCALAR; level <= best; level++) {
+        float error = soa_max_error((SimdLevel)level);
+        std::cout << "solver: soa " << simd_level_name((SimdLevel)level)
+            << " (max error " << error << ", "
+            << (error <= SOA_KERNEL_TOLERANCE ? "ok" : "OUT OF TOLERANCE")
+            << ")" << std::endl;
+
+        for (size_t i = 0; i < bench_grids.size(); i++) {
+            const GridSize& grid = bench_grids[i];
+            SoaSpringSolver solver(grid.x, grid.y, (SimdLevel)level);
+            double rate = measure_node_updates(solver.points_total(),
+                [&](int n) { solver.step(n); });
+
+            std::cout << "  " << grid.x << "x" << grid.y << ": "
+                << rate / 1e6 << " M node-updates/s ("
+                << rate / reference_rates[i] << "x reference)" << std::endl;
+        }
+    }
+}
+
+// The reference and SoA solvers under each pin layout, counting only the
+// free nodes they step; swaying pins also check the SoA solver still
+// tracks the reference.
+static void bench_pins() {
+    struct PinCase {
+        PinLayout layout;
+        float sway;
+    };
+    static const PinCase cases[] = {
+        { PINS_TOP_ROW, 0.0f },
+        { PINS_TOP_CORNERS, 0.0f },
+        { PINS_TOP_ROW, 2.0f },
+        { PINS_TOP_CORNERS, 2.0f },
+    };
+
+    for (const PinCase& pin_case : cases) {
+        SpringParams params;
+        params.pins = pin_case.layout;
+        params.pin_sway = pin_case.sway;
+
+        std::cout << "pins: " << pin_layout_name(pin_case.layout);
+        if (pin_case.sway > 0.0f) {
+            float error = soa_max_error(detect_simd_level(), params);
+            std::cout << ", swaying " << pin_case.sway << " (soa max error " << error << ", "
+                << (error <= SOA_KERNEL_TOLERANCE ? "ok" : "OUT OF TOLERANCE") << ")";
+        }
+        std::cout << std::endl;
+
+        for (const GridSize& grid : bench_grids) {
+            SpringMassSolver reference(grid.x, grid.y);
+            reference.params() = params;
+            reference.reset();
+            SoaSpringSolver soa(grid.x, grid.y);
+            soa.params() = params;
+            soa.reset();
+
+            int free_nodes = reference.points_total() - reference.pins().size();
+            double reference_rate = measure_node_updates(free_nodes,
+                [&](int n) { reference.step(n); });
+            double soa_rate = measure_node_updates(free_nodes,
+                [&](int n) { soa.step(n); });
+
+            std::cout << "  " << grid.x << "x" << grid.y << ": " << reference.pins().size()
+                << " pins, reference " << reference_rate / 1e6 << ", soa "
+                << soa_rate / 1e6 << " M node-updates/s" << std::endl;
+        }
+    }
+}
+
+// Thread counts to try: powers of two up to the hardware thread count,
+// plus the hardware thread count itself.
+static std::vector<int> bench_thread_counts() {
+    std::vector<int> counts;
+    int hardware = ThreadPool::hardware_threads();
+    for (int n = 1; n < hardware; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(hardware);
+    return counts;
+}
+
+static void bench_parallel() {
+    std::vector<GridSize> parallel_grids;
+    for (const GridSize& grid : bench_grids) {
+        if (bench_grids.size() == 1 || grid.x * grid.y >= 1024 * 1024) {
+            parallel_grids.push_back(grid);
+        }
+    }
+
+    SimdLevel level = detect_simd_level();
+    std::vector<int> thread_counts = bench_thread_counts();
+
+    std::cout << "solver: soa " << simd_level_name(level) << ", tiled" << std::endl;
+
+    for (const GridSize& grid : parallel_grids) {
+        SoaSpringSolver solver(grid.x, grid.y, level);
+        double single_rate = 0;
+
+        for (int threads : thread_counts) {
+            ThreadPool pool(threads);
+            solver.set_thread_pool(&pool);
+            double rate = measure_node_updates(solver.points_total(),
+                [&](int n) { solver.step(n); });
+            solver.set_thread_pool(nullptr);
+
+            if (threads == 1) {
+                single_rate = rate;
+            }
+
+            std::cout << "  " << grid.x << "x" << grid.y << ", "
+                << threads << " threads: " << rate / 1e6 << " M node-updates/s, "
+                << 100.0 * rate / (single_rate * threads) << "% efficiency" << std::endl;
+        }
+    }
+}
+
+struct SpringSet {
+    const char* name;
+    float k_shear;
+    float k_bend;
+};
+
+static const SpringSet spring_sets[] = {
+    { "axial", 0.0f, 0.0f },
+    { "axial+shear", 7.1f, 0.0f },
+    { "axial+bend", 0.0f, 2.0f },
+    { "axial+shear+bend", 7.1f, 2.0f },
+};
+
+// Simulated time one demo frame covers: iterations_per_frame steps of
+// the default t.
+static const float bench_frame_time = 16 * 0.07f;
+
+// Frames the stability checks run before looking at the cloth.
+static const int stability_frames = 300;
+
+// Whether nothing has gone non-finite and the cloth has come to rest with
+// no spring badly overstretched.
+static bool cloth_settled(const SpringTopology& topology, const Vec4f* positions,
+    const Vec3f* velocities) {
+
+    for (int n = 0; n < topology.nodes(); n++) {
+        const Vec4f& p = positions[n];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z) ||
+            velocities[n].length() > 0.05f) {
+            return false;
+        }
+
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            const Vec4f& q = positions[topology.neighbours[s]];
+            float x = Vec3f(q.x - p.x, q.y - p.y, q.z - p.z).length();
+            if (x > 2.0f * topology.coeffs[s].rest_length) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool cloth_settled(const SpringMassSolver& solver) {
+    return cloth_settled(solver.topology(), solver.positions(), solver.velocities());
+}
+
+// Mean and largest (x - rest_length) / rest_length over all springs.
+static void spring_strain(const SpringTopology& topology, const Vec4f* positions,
+    float& mean_strain, float& max_strain) {
+
+    double sum = 0;
+    max_strain = 0.0f;
+    for (int n = 0; n < topology.nodes(); n++) {
+        const Vec4f& p = positions[n];
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            const Vec4f& q = positions[topology.neighbours[s]];
+            float x = Vec3f(q.x - p.x, q.y - p.y, q.z - p.z).length();
+            float strain = (x - topology.coeffs[s].rest_length) / topology.coeffs[s].rest_length;
+            sum += strain;
+            max_strain = std::max(max_strain, strain);
+        }
+    }
+    mean_strain = topology.springs() ? (float)(sum / topology.springs()) : 0.0f;
+}
+
+// Prints "strain mean/max" for the cloth.
+static void print_strain(const SpringTopology& topology, const Vec4f* positions) {
+    float mean_strain, max_strain;
+    spring_strain(topology, positions, mean_strain, max_strain);
+    std::cout << "strain " << mean_strain << "/" << max_strain;
+}
+
+// Whether the cloth settles when each frame is split into substeps steps.
+static bool cloth_is_stable(const SpringSet& set, int substeps) {
+    SpringMassSolver solver(50, 50);
+    solver.params().t = bench_frame_time / substeps;
+    solver.params().k_shear = set.k_shear;
+    solver.params().k_bend = set.k_bend;
+    solver.reset();
+    solver.step(stability_frames * substeps);
+
+    return cloth_settled(solver);
+}
+
+// Fewest substeps per frame that keep each spring set stable, against
+// what each substep costs, so iterations_per_frame can be traded for
+// spring count.
+static void bench_springs() {
+    static const int substep_counts[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+
+    std::cout << "springs: substeps per " << bench_frame_time << " time units to stay stable" << std::endl;
+
+    for (const SpringSet& set : spring_sets) {
+        int stable_substeps = 0;
+        for (int substeps : substep_counts) {
+            if (cloth_is_stable(set, substeps)) {
+                stable_substeps = substeps;
+                break;
+            }
+        }
+
+        std::cout << "  " << set.name << ": ";
+        if (stable_substeps) {
+            std::cout << stable_substeps << " substeps/frame" << std::endl;
+        }
+        else {
+            std::cout << "unstable at every substep count tried" << std::endl;
+        }
+
+        for (const GridSize& grid : bench_grids) {
+            SpringMassSolver solver(grid.x, grid.y);
+            solver.params().k_shear = set.k_shear;
+            solver.params().k_bend = set.k_bend;
+            solver.reset();
+
+            double rate = measure_node_updates(solver.points_total(),
+                [&](int n) { solver.step(n); });
+            double ns_per_node = 1e9 / rate;
+
+            std::cout << "    " << grid.x << "x" << grid.y << ": "
+                << solver.topology().springs() / (double)solver.points_total() << " springs/node, "
+                << ns_per_node << " ns/node-substep";
+            if (stable_substeps) {
+                std::cout << ", " << ns_per_node * stable_substeps << " ns/node-frame";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+struct AdaptiveScenario {
+    const char* name;
+    float k;
+    float k_shear;
+    float k_bend;
+    float rest_length;
+};
+
+// The demo cloth, then cloths the fixed 16 substeps over- or
+// under-provision for.
+static const AdaptiveScenario adaptive_scenarios[] = {
+    { "default", 7.1f, 0.0f, 0.0f, 0.88f },
+    { "shear+bend", 7.1f, 7.1f, 2.0f, 0.88f },
+    { "stiff k=30", 30.0f, 0.0f, 0.0f, 0.88f },
+    { "rest 0.8", 7.1f, 0.0f, 0.0f, 0.8f },
+};
+
+static void reset_scenario(const AdaptiveScenario& scenario, SpringMassSolver& solver) {
+    solver.params().k = scenario.k;
+    solver.params().k_shear = scenario.k_shear;
+    solver.params().k_bend = scenario.k_bend;
+    solver.params().rest_length = scenario.rest_length;
+    solver.reset();
+}
+
+// Runs stability_frames frames with the adaptive stepper choosing each
+// frame's substeps.
+static void run_adaptive(SpringMassSolver& solver, AdaptiveStepper& stepper) {
+    stepper.start(solver.topology(), solver.pins(), solver.positions(), solver.params().c,
+        AdaptiveStepLimits());
+    for (int frame = 0; frame < stability_frames; frame++) {
+        int substeps = stepper.substeps(bench_frame_time);
+        solver.params().t = bench_frame_time / substeps;
+        solver.step(substeps);
+        stepper.observe(solver.positions(), bench_frame_time);
+    }
+}
+
+// Substeps and wall time the adaptive stepper needs against the demo's
+// fixed 16 substeps per frame, and whether each ends up settled.
+static void bench_adaptive() {
+    const int fixed_substeps = 16;
+
+    std::cout << "adaptive: " << stability_frames << " frames of " << bench_frame_time <<
+        " time units, 50x50" << std::endl;
+
+    for (const AdaptiveScenario& scenario : adaptive_scenarios) {
+        SpringMassSolver solver(50, 50);
+
+        reset_scenario(scenario, solver);
+        solver.params().t = bench_frame_time / fixed_substeps;
+        bench_clock::time_point start = bench_clock::now();
+        solver.step(stability_frames * fixed_substeps);
+        double fixed_seconds = seconds_since(start);
+        bool fixed_stable = cloth_settled(solver);
+
+        reset_scenario(scenario, solver);
+        AdaptiveStepper stepper;
+        start = bench_clock::now();
+        run_adaptive(solver, stepper);
+        double adaptive_seconds = seconds_since(start);
+
+        std::cout << "  " << scenario.name << ": stable t < " << stepper.stable_step() << std::endl;
+        std::cout << "    fixed: " << fixed_seconds * 1e3 << " ms, " <<
+            (fixed_stable ? "stable" : "unstable") << std::endl;
+        std::cout << "    adaptive: " << adaptive_seconds * 1e3 << " ms, " <<
+            (cloth_settled(solver) ? "stable" : "unstable") << ", ";
+        stepper.print_stats(std::cout, fixed_substeps);
+    }
+
+    // A blown-up cloth, one NaN node or a finite but huge state, has to
+    // get max_substeps rather than the calm count.
+    SpringMassSolver solver(50, 50);
+    AdaptiveStepLimits limits;
+    int guarded[2];
+    for (int huge = 0; huge < 2; huge++) {
+        std::vector<Vec4f> blown(solver.positions(), solver.positions() + solver.points_total());
+        if (huge) {
+            for (Vec4f& p : blown) {
+                p = Vec4f(p.x * 1e15f, p.y * 1e15f, p.z * 1e15f, p.w);
+            }
+        }
+        else {
+            blown[solver.points_total() / 2].x = NAN;
+        }
+
+        AdaptiveStepper stepper;
+        stepper.start(solver.topology(), solver.pins(), solver.positions(), solver.params().c, limits);
+        stepper.observe(blown.data(), bench_frame_time);
+        guarded[huge] = stepper.substeps(bench_frame_time);
+    }
+    std::cout << "  blow-up guard: NaN node " << guarded[0] << ", huge state " << guarded[1] <<
+        " substeps (" << (guarded[0] == limits.max_substeps && guarded[1] == limits.max_substeps ?
+        "ok" : "WRONG") << ")" << std::endl;
+}
+
+// Runs frame() until min_bench_seconds have passed and returns the
+// average seconds per call.
+template <typename FrameFunc>
+static double measure_frame_seconds(FrameFunc frame) {
+    frame();
+
+    int frames = 0;
+    bench_clock::time_point start = bench_clock::now();
+    double elapsed;
+    do {
+        frame();
+        frames++;
+        elapsed = seconds_since(start);
+    } while (elapsed < min_bench_seconds);
+
+    return elapsed / frames;
+}
+
+// One backward Euler step per frame against explicit substeps. Stability
+// is checked on each scenario's 50x50 cloth, with the explicit side run
+// by the adaptive stepper so it is stable too; both must settle to the
+// same shape. Wall time per frame then compares the implicit solver with
+// the pooled SoA kernel at the demo's 16 substeps.
+static void bench_implicit() {
+    const int explicit_substeps = 16;
+    ThreadPool pool(ThreadPool::hardware_threads());
+
+    std::cout << "implicit: one step per " << bench_frame_time << " time units, " <<
+        stability_frames << " frames, 50x50" << std::endl;
+
+    for (const AdaptiveScenario& scenario : adaptive_scenarios) {
+        SpringMassSolver reference(50, 50);
+        reset_scenario(scenario, reference);
+        AdaptiveStepper stepper;
+        bench_clock::time_point start = bench_clock::now();
+        run_adaptive(reference, stepper);
+        double explicit_seconds = seconds_since(start);
+
+        ImplicitSolver solver(50, 50);
+        solver.params() = reference.params();
+        solver.params().t = bench_frame_time;
+        solver.reset();
+        start = bench_clock::now();
+        solver.step(stability_frames);
+        double implicit_seconds = seconds_since(start);
+
+        bool settled = true;
+        float max_distance = 0.0f;
+        for (int n = 0; n < solver.points_total(); n++) {
+            const Vec4f& p = solver.positions()[n];
+            const Vec4f& q = reference.positions()[n];
+            max_distance = std::max(max_distance, Vec3f(p.x - q.x, p.y - q.y, p.z - q.z).length());
+            settled = settled && std::isfinite(max_distance) && solver.velocities()[n].length() <= 0.05f;
+        }
+
+        std::cout << "  " << scenario.name << ": explicit " << stepper.substeps_run() / (double)stability_frames <<
+            " substeps/frame, " << explicit_seconds * 1e3 << " ms, " <<
+            (cloth_settled(reference) ? "stable" : "unstable") << "; implicit " <<
+            solver.solve_iterations() / (double)stability_frames << " CG iterations/frame, " <<
+            implicit_seconds * 1e3 << " ms, " << (settled ? "stable" : "unstable") <<
+            ", " << max_distance << " from explicit" << std::endl;
+    }
+
+    std::cout << "  wall time per frame, " << pool.thread_count() << " threads:" << std::endl;
+    for (const GridSize& grid : bench_grids) {
+        SoaSpringSolver explicit_solver(grid.x, grid.y);
+        explicit_solver.set_thread_pool(&pool);
+        double explicit_seconds = measure_frame_seconds([&]() {
+            explicit_solver.step(explicit_substeps);
+        });
+
+        ImplicitSolver solver(grid.x, grid.y);
+        solver.set_thread_pool(&pool);
+        solver.params().t = bench_frame_time;
+        double implicit_seconds = measure_frame_seconds([&]() {
+            solver.step();
+        });
+
+        std::cout << "    " << grid.x << "x" << grid.y << ": explicit " << explicit_substeps <<
+            " substeps " << explicit_seconds * 1e3 << " ms, implicit " <<
+            implicit_seconds * 1e3 << " ms (" << solver.solve_iterations() / (double)(solver.iteration_index()) <<
+            " CG iterations)" << std::endl;
+    }
+}
+
+struct RelaxationScheme {
+    const char* name;
+    ImplicitSolve solve;
+    float weight;
+};
+
+static const RelaxationScheme relaxation_schemes[] = {
+    { "cg", SOLVE_CG, 1.0f },
+    { "jacobi", SOLVE_JACOBI, 1.0f },
+    { "jacobi w=0.67", SOLVE_JACOBI, 0.67f },
+    { "gauss-seidel", SOLVE_GAUSS_SEIDEL, 1.0f },
+    { "sor w=1.5", SOLVE_GAUSS_SEIDEL, 1.5f },
+    { "sor w=1.8", SOLVE_GAUSS_SEIDEL, 1.8f },
+};
+
+// The first implicit step's solve, from dv = 0, by each scheme for a fixed
+// number of iterations. Reports how many orders of magnitude that cut the
+// residual by and how many per millisecond of solving; the solve's time
+// is the step's less that of a step with no iterations at all.
+static void bench_relaxation() {
+    const int iterations = 20;
+    ThreadPool pool(ThreadPool::hardware_threads());
+
+    std::cout << "relaxation: first implicit step of " << bench_frame_time << " time units, " <<
+        iterations << " iterations, " << pool.thread_count() << " threads" << std::endl;
+
+    for (const GridSize& grid : bench_grids) {
+        ImplicitSolver solver(grid.x, grid.y);
+        solver.set_thread_pool(&pool);
+        solver.params().t = bench_frame_time;
+
+        solver.set_solve_limits(0.0f, 0);
+        double base_seconds = measure_frame_seconds([&]() {
+            solver.reset();
+            solver.step();
+        });
+
+        std::cout << "  " << grid.x << "x" << grid.y << " (" << solver.color_count() << " colours):" << std::endl;
+        for (const RelaxationScheme& scheme : relaxation_schemes) {
+            solver.set_solve(scheme.solve, scheme.weight);
+            solver.set_solve_limits(0.0f, iterations);
+            double seconds = measure_frame_seconds([&]() {
+                solver.reset();
+                solver.step();
+            }) - base_seconds;
+
+            double orders = -log10(solver.last_residual_reduction());
+            std::cout << "    " << scheme.name << ": " << seconds * 1e3 << " ms, " <<
+                orders << " orders, " << orders / (seconds * 1e3) << " per ms" << std::endl;
+        }
+    }
+}
+
+// Stiffnesses for the multigrid comparison: the demo's, and one where the
+// springs outweigh the mass term by a thousand or so.
+static const float multigrid_stiffnesses[] = { 7.1f, 1000.0f };
+
+// The first implicit step solved to a 1e-4 residual cut by CG, SOR and
+// multigrid V-cycles, reporting iterations and solve time per node; only
+// multigrid should hold the latter roughly flat as the grid grows.
+static void bench_multigrid() {
+    const RelaxationScheme schemes[] = {
+        { "cg", SOLVE_CG, 1.0f },
+        { "sor w=1.5", SOLVE_GAUSS_SEIDEL, 1.5f },
+        { "multigrid", SOLVE_MULTIGRID, 1.0f },
+    };
+    const int max_iterations = 2000;
+    ThreadPool pool(ThreadPool::hardware_threads());
+
+    std::cout << "multigrid: first implicit step of " << bench_frame_time << " time units to a 1e-4 residual, " <<
+        pool.thread_count() << " threads" << std::endl;
+
+    for (float k : multigrid_stiffnesses) {
+        std::cout << "  k = " << k << ":" << std::endl;
+        for (const GridSize& grid : bench_grids) {
+            ImplicitSolver solver(grid.x, grid.y);
+            solver.set_thread_pool(&pool);
+            solver.params().t = bench_frame_time;
+            solver.params().k = k;
+
+            solver.set_solve_limits(0.0f, 0);
+            double base_seconds = measure_frame_seconds([&]() {
+                solver.reset();
+                solver.step();
+            });
+
+            std::cout << "    " << grid.x << "x" << grid.y << " (" << solver.coarse_levels() <<
+                " coarse levels):";
+            for (const RelaxationScheme& scheme : schemes) {
+                solver.set_solve(scheme.solve, scheme.weight);
+                solver.set_solve_limits(1e-4f, max_iterations);
+                double seconds = measure_frame_seconds([&]() {
+                    solver.reset();
+                    solver.step();
+                }) - base_seconds;
+
+                std::cout << " " << scheme.name << " " << solver.last_solve_iterations();
+                if (solver.last_residual_reduction() > 1e-4) {
+                    std::cout << " (capped)";
+                }
+                std::cout << " its " << seconds * 1e9 / solver.points_total() << " ns/node;";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+// Stiffnesses for the XPBD comparison: the demo's, one the explicit pass
+// needs about 40 substeps for, and one it can't reach within 64.
+static const float xpbd_stiffnesses[] = { 7.1f, 30.0f, 1000.0f };
+
+// XPBD at the demo's 16 substeps per frame, one constraint pass each,
+// against the explicit pass with the adaptive stepper. Reports the
+// colours each spring set needs, how stiff the settled cloth ends up
+// (its strain) and, for the largest bench grid, how a frame scales with
+// threads. Strain is reported as mean/max.
+static void bench_xpbd() {
+    const int substeps = 16;
+
+    std::cout << "xpbd: constraint colours" << std::endl;
+    for (const SpringSet& set : spring_sets) {
+        SpringParams params;
+        params.k_shear = set.k_shear;
+        params.k_bend = set.k_bend;
+        SpringTopology topology;
+        build_cloth_topology(50, 50, params, topology);
+
+        std::vector<DistanceConstraint> constraints;
+        std::vector<int> colors;
+        build_distance_constraints(topology, constraints);
+        std::cout << "  " << set.name << ": " << color_constraints(constraints, topology.nodes(), colors) <<
+            " colours, " << constraints.size() << " constraints" << std::endl;
+    }
+
+    std::cout << "xpbd: " << stability_frames << " frames of " << substeps <<
+        " substeps x 1 pass, 50x50" << std::endl;
+    for (float k : xpbd_stiffnesses) {
+        SpringMassSolver reference(50, 50);
+        reference.params().k = k;
+        reference.reset();
+        AdaptiveStepper stepper;
+        bench_clock::time_point start = bench_clock::now();
+        run_adaptive(reference, stepper);
+        double explicit_seconds = seconds_since(start);
+        bool explicit_stable = cloth_settled(reference);
+
+        XpbdSolver solver(50, 50);
+        solver.params().k = k;
+        solver.params().t = bench_frame_time / substeps;
+        solver.reset();
+        solver.set_iterations(1);
+        start = bench_clock::now();
+        solver.step(stability_frames * substeps);
+        double xpbd_seconds = seconds_since(start);
+
+        SpringTopology topology;
+        build_cloth_topology(50, 50, solver.params(), topology);
+
+        std::cout << "  k=" << k << ": explicit " << stepper.substeps_run() / (double)stability_frames <<
+            " substeps/frame, " << explicit_seconds * 1e3 << " ms, ";
+        if (explicit_stable) {
+            print_strain(reference.topology(), reference.positions());
+        }
+        else {
+            std::cout << "unstable";
+        }
+        std::cout << "; xpbd " << xpbd_seconds * 1e3 << " ms, " <<
+            (cloth_settled(topology, solver.positions(), solver.velocities()) ? "" : "unsettled, ");
+        print_strain(topology, solver.positions());
+        std::cout << std::endl;
+    }
+
+    const GridSize& grid = bench_grids.back();
+    std::cout << "xpbd: " << grid.x << "x" << grid.y << " frame time by threads" << std::endl;
+    for (int threads : bench_thread_counts()) {
+        ThreadPool pool(threads);
+        XpbdSolver solver(grid.x, grid.y);
+        solver.set_thread_pool(&pool);
+        solver.set_iterations(1);
+        solver.params().t = bench_frame_time / substeps;
+        double seconds = measure_frame_seconds([&]() {
+            solver.step(substeps);
+        });
+        std::cout << "  " << threads << " threads: " << seconds * 1e3 << " ms" << std::endl;
+    }
+}
+
+// Counts last-level cache misses of this thread where perf events are
+// available (Linux, perf_event_paranoid permitting).
+class CacheMissCounter {
+public:
+    CacheMissCounter() : m_fd(-1) {
+#if defined(__linux__)
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter() {
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+#endif
+    }
+
+    bool available() const { return m_fd >= 0; }
+
+    void start() {
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop() {
+        long long count = 0;
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int m_fd;
+};
+
+// Fraction of spring fetches that land within a 4 KB page of the node's
+// own position.
+static double near_fetch_fraction(const SpringTopology& topology) {
+    const int near_nodes = 4096 / sizeof(Vec4f);
+
+    long long near = 0;
+    for (int n = 0; n < topology.nodes(); n++) {
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            if (std::abs(topology.neighbours[s] - n) < near_nodes) {
+                near++;
+            }
+        }
+    }
+    return (double)near / std::max(topology.springs(), 1);
+}
+
+// Wide grids of about a million nodes each, where a row-major n +- points_x
+// fetch lands 16-64 KB away.
+static const GridSize ordering_grids[] = {
+    { 1024, 1024 },
+    { 2048, 512 },
+    { 4096, 256 },
+};
+
+static void bench_ordering() {
+    static const NodeOrder orders[] = { ORDER_ROW_MAJOR, ORDER_MORTON, ORDER_HILBERT };
+    const int steps = 8;
+
+    std::vector<GridSize> grids(ordering_grids,
+        ordering_grids + sizeof(ordering_grids) / sizeof(ordering_grids[0]));
+    if (bench_grids.size() == 1) {
+        grids = bench_grids;
+    }
+
+    CacheMissCounter misses;
+    std::cout << "ordering: scalar reference solver";
+    if (!misses.available()) {
+        std::cout << " (no perf events, cache misses not counted)";
+    }
+    std::cout << std::endl;
+
+    for (const GridSize& grid : grids) {
+        double row_major_rate = 0;
+
+        for (NodeOrder order : orders) {
+            SpringMassSolver solver(grid.x, grid.y, order);
+
+            misses.start();
+            solver.step(steps);
+            long long miss_count = misses.stop();
+
+            double rate = measure_node_updates(solver.points_total(),
+                [&](int n) { solver.step(n); });
+            if (order == ORDER_ROW_MAJOR) {
+                row_major_rate = rate;
+            }
+
+            std::cout << "  " << grid.x << "x" << grid.y << " " << node_order_name(order) << ": "
+                << rate / 1e6 << " M node-updates/s (" << rate / row_major_rate << "x row-major), "
+                << 100.0 * near_fetch_fraction(solver.topology()) << "% fetches within 4 KB";
+            if (misses.available()) {
+                std::cout << ", " << (double)miss_count / ((double)steps * solver.points_total())
+                    << " cache misses/node-update";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+// Records pre-simulated frames of the largest bench grid as fast as the
+// recorder accepts them, then reads them back to check the error bound.
+static void bench_recorder() {
+    const int frames = 30;
+    const int substeps_per_frame = 16;
+    const float error_bound = 1e-3f;
+    const char* path = "bench_trajectory.traj";
+
+    GridSize grid = bench_grids.back();
+    SoaSpringSolver solver(grid.x, grid.y);
+    ThreadPool pool(ThreadPool::hardware_threads());
+    solver.set_thread_pool(&pool);
+
+    int points = solver.points_total();
+    std::vector<std::vector<Vec4f> > recorded(frames, std::vector<Vec4f>(points));
+    std::vector<Vec3f> velocities(points);
+    for (int f = 0; f < frames; f++) {
+        solver.step(substeps_per_frame);
+        solver.read_back(recorded[f].data(), velocities.data());
+    }
+
+    TrajectoryRecorder recorder;
+    if (!recorder.open(path, points, error_bound)) {
+        return;
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int f = 0; f < frames; f++) {
+        Vec4f* dst;
+        while (!(dst = recorder.begin_frame(f))) {
+            std::this_thread::yield();
+        }
+        std::copy(recorded[f].begin(), recorded[f].end(), dst);
+        recorder.end_frame();
+    }
+    bool written = recorder.close();
+    double elapsed = seconds_since(start);
+
+    double raw_bytes = (double)frames * points * sizeof(Vec4f);
+    double bytes = (double)recorder.bytes_written();
+
+    float max_error = 0;
+    int unreadable = frames;
+    TrajectoryReader reader;
+    std::vector<float> xyz((size_t)points * 3);
+    if (written && reader.open(path)) {
+        unreadable = 0;
+        for (int f = 0; f < frames; f++) {
+            if (!reader.read_frame(f, xyz.data())) {
+                unreadable++;
+                continue;
+            }
+            for (int n = 0; n < points; n++) {
+                max_error = std::max(max_error, std::fabs(xyz[n * 3 + 0] - recorded[f][n].x));
+                max_error = std::max(max_error, std::fabs(xyz[n * 3 + 1] - recorded[f][n].y));
+                max_error = std::max(max_error, std::fabs(xyz[n * 3 + 2] - recorded[f][n].z));
+            }
+        }
+    }
+    remove(path);
+
+    std::cout << "recorder: " << grid.x << "x" << grid.y << ", error bound " << error_bound << std::endl;
+    std::cout << "  " << frames / elapsed << " frames/s, "
+        << bytes / frames / 1e6 << " MB/frame ("
+        << raw_bytes / bytes << "x smaller than float32 readback), "
+        << bytes / elapsed / 1e6 << " MB/s to disk" << std::endl;
+    std::cout << "  max decoded error " << max_error << ", " << unreadable << " frames unreadable" << std::endl;
+}
+
+// Vec4f as vec_stuff.h used to define it: user-provided copy constructor
+// and self-checking assignment, so not trivially copyable, and indexing
+// through an if-chain.
+struct LegacyVec4f {
+    float x;
+    float y;
+    float z;
+    float w;
+
+    LegacyVec4f(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {
+    }
+
+    LegacyVec4f() : LegacyVec4f(0, 0, 0, 0) {
+    }
+
+    LegacyVec4f(const LegacyVec4f& other) : LegacyVec4f(other.x, other.y, other.z, other.w) {
+    }
+
+    LegacyVec4f& operator=(const LegacyVec4f& rhs) {
+        if (this != &rhs) {
+            x = rhs.x;
+            y = rhs.y;
+            z = rhs.z;
+            w = rhs.w;
+        }
+        return *this;
+    }
+
+    float operator[](int i) const {
+        if (i == 0) return x;
+        if (i == 1) return y;
+        if (i == 2) return z;
+        if (i == 3) return w;
+
+        assert(false);
+        return 0;
+    }
+
+    LegacyVec4f operator+(const LegacyVec4f& rhs) const {
+        LegacyVec4f result = { x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w };
+        return result;
+    }
+
+    LegacyVec4f operator-(const LegacyVec4f& rhs) const {
+        LegacyVec4f result = { x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w };
+        return result;
+    }
+
+    LegacyVec4f operator*(float scalar) const {
+        LegacyVec4f result = { x * scalar, y * scalar, z * scalar, w * scalar };
+        return result;
+    }
+};
+
+// Keeps the vector benchmarks' results alive, and their component count
+// (a power of two) unknown at compile time.
+static volatile float vector_sink;
+static volatile int vector_components = 4;
+
+struct VectorRates {
+    double fill;
+    double copy;
+    double lerp;
+    double index;
+};
+
+// Vectors per second for a positions-sized array of V: value-initializing
+// it, copying it to a staging array (as for a GL upload), interpolating
+// between two of them (as SimulationThread::interpolate() does) and
+// summing one scattered, unpredictable component of each through
+// operator[].
+template <typename V>
+static VectorRates measure_vectors(int count) {
+    std::vector<V> a(count), b(count), out(count);
+    for (int n = 0; n < count; n++) {
+        a[n] = V((float)n, (float)(n % 7), (float)(n % 13), 1.0f);
+        b[n] = V((float)(n % 5), (float)n, (float)(n % 11), 1.0f);
+    }
+    int components = vector_components;
+
+    VectorRates rates;
+    rates.fill = count / measure_frame_seconds([&]() {
+        std::vector<V> filled(count);
+        vector_sink = filled[count - 1].w;
+    });
+    rates.copy = count / measure_frame_seconds([&]() {
+        std::copy(a.begin(), a.end(), out.begin());
+        vector_sink = out[count - 1].x;
+    });
+    rates.lerp = count / measure_frame_seconds([&]() {
+        const float alpha = 0.25f;
+        for (int n = 0; n < count; n++) {
+            out[n] = a[n] + (b[n] - a[n]) * alpha;
+        }
+        vector_sink = out[count - 1].y;
+    });
+    rates.index = count / measure_frame_seconds([&]() {
+        float sum = 0.0f;
+        for (int n = 0; n < count; n++) {
+            sum += a[n][(unsigned)(n * 2654435761u) >> 30 & (components - 1)];
+        }
+        vector_sink = sum;
+    });
+    return rates;
+}
+
+// The current Vec4f against LegacyVec4f on each grid's position array.
+static void bench_vectors() {
+#if defined(VEC4F_SSE)
+    const char* backing = "SSE";
+#elif defined(VEC4F_NEON)
+    const char* backing = "NEON";
+#else
+    const char* backing = "scalar";
+#endif
+    std::cout << "vectors: Vec4f (" << backing << ") against the old user-copyable Vec4f, M vectors/s" << std::endl;
+
+    for (const GridSize& grid : bench_grids) {
+        int count = grid.x * grid.y;
+        VectorRates legacy = measure_vectors<LegacyVec4f>(count);
+        VectorRates current = measure_vectors<Vec4f>(count);
+
+        std::cout << "  " << grid.x << "x" << grid.y << ":" << std::endl;
+        std::cout << "    fill: " << legacy.fill / 1e6 << " -> " << current.fill / 1e6 << std::endl;
+        std::cout << "    copy: " << legacy.copy / 1e6 << " -> " << current.copy / 1e6 << std::endl;
+        std::cout << "    lerp: " << legacy.lerp / 1e6 << " -> " << current.lerp / 1e6 << std::endl;
+        std::cout << "    index: " << legacy.index / 1e6 << " -> " << current.index / 1e6 << std::endl;
+    }
+}
+
+// mult_matrices() and add_y_rotation_to_matrix() as gl_utils.cpp used to
+// have them: a scalar triple loop through a temporary, and a rotation
+// built on an identity matrix and multiplied in.
+static void legacy_mult_matrices(const Matrix44f& m1, const Matrix44f& m2, Matrix44f& result) {
+    Matrix44f tmp_result = {0};
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            for (int i = 0; i < 4; i++) {
+                tmp_result[x][y] += m1[x][i] * m2[i][y];
+            }
+        }
+    }
+
+    memcpy(result, tmp_result, sizeof(result));
+}
+
+static void legacy_add_y_rotation_to_matrix(Matrix44f& m, float rot) {
+    Matrix44f rot_matrix;
+    get_identity_matrix(rot_matrix);
+
+    float s = sin(rot);
+    float c = cos(rot);
+
+    rot_matrix[0][0] = c;
+    rot_matrix[2][0] = s;
+    rot_matrix[0][2] = -s;
+    rot_matrix[2][2] = c;
+
+    legacy_mult_matrices(m, rot_matrix, m);
+}
+
+static float max_matrix_difference(const Matrix44f& a, const Matrix44f& b) {
+    float difference = 0.0f;
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            difference = std::max(difference, std::fabs(a[x][y] - b[x][y]));
+        }
+    }
+    return difference;
+}
+
+// A fixed camera, as a view-projection matrix built at run time.
+static void bench_view_projection(Matrix44f& result) {
+    float b, t, l, r;
+    Matrix44f proj, view;
+    get_perspective_info(45.0f, 4.0f / 3.0f, 0.1f, 100.0f, b, t, l, r);
+    calc_proj_matrix(b, t, l, r, 0.1f, 100.0f, proj);
+    calc_lookat_matrix(Vec3f(0, 2, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0), view);
+    mult_matrices(view, proj, result);
+}
+
+// The same camera folded into static data at compile time.
+static constexpr Matrix44fValue bench_camera = mult_matrices(
+    lookat_matrix(Vec3f(0, 2, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0)),
+    perspective_matrix(45.0f, 4.0f / 3.0f, 0.1f, 100.0f));
+
+// get_perspective_info() as it was before it stayed in float.
+static void legacy_get_perspective_info(float fov, float aspect_ratio, float near,
+    float& b, float& t, float& l, float& r) {
+
+    float scale = tan(fov * 0.5 * PI / 180) * near;
+    r = aspect_ratio * scale;
+    l = -r;
+    t = scale;
+    b = -t;
+}
+
+// Matrix multiplies and y rotations, old and new, in chains of
+// matrix_chain dependent updates; then transform_points() on each grid's
+// positions against a plain loop and against memcpy of the same bytes,
+// which is as fast as a bandwidth-bound transform can go.
+static void bench_matrices() {
+    const int matrix_chain = 1000;
+
+    Matrix44f step;
+    bench_view_projection(step);
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            step[x][y] *= 0.5f;
+        }
+    }
+
+    Matrix44f legacy, current;
+    std::cout << "matrices: 4x4 kernels, M updates/s" << std::endl;
+
+    get_identity_matrix(legacy);
+    double legacy_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < matrix_chain; i++) {
+            legacy_mult_matrices(legacy, step, legacy);
+        }
+    });
+    get_identity_matrix(current);
+    double current_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < matrix_chain; i++) {
+            mult_matrices(current, step, current);
+        }
+    });
+    get_identity_matrix(legacy);
+    get_identity_matrix(current);
+    legacy_mult_matrices(legacy, step, legacy);
+    mult_matrices(current, step, current);
+    std::cout << "  multiply: " << matrix_chain / legacy_seconds / 1e6 << " -> " <<
+        matrix_chain / current_seconds / 1e6 << " (max difference " <<
+        max_matrix_difference(legacy, current) << ")" << std::endl;
+
+    bench_view_projection(legacy);
+    legacy_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < matrix_chain; i++) {
+            legacy_add_y_rotation_to_matrix(legacy, 0.01f);
+        }
+    });
+    bench_view_projection(current);
+    current_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < matrix_chain; i++) {
+            add_y_rotation_to_matrix(current, 0.01f);
+        }
+    });
+    bench_view_projection(legacy);
+    bench_view_projection(current);
+    legacy_add_y_rotation_to_matrix(legacy, 0.3f);
+    add_y_rotation_to_matrix(current, 0.3f);
+    std::cout << "  y rotation: " << matrix_chain / legacy_seconds / 1e6 << " -> " <<
+        matrix_chain / current_seconds / 1e6 << " (max difference " <<
+        max_matrix_difference(legacy, current) << ")" << std::endl;
+
+    Matrix44f view_projection;
+    bench_view_projection(view_projection);
+    std::cout << "matrices: cloth positions to clip space, GB/s read + written" << std::endl;
+
+    for (const GridSize& grid : bench_grids) {
+        SpringMassSolver solver(grid.x, grid.y);
+        int count = solver.points_total();
+        const Vec4f* points = solver.positions();
+        std::vector<Vec4f> transformed(count), reference(count);
+        double bytes = 2.0 * count * sizeof(Vec4f);
+
+        double loop_seconds = measure_frame_seconds([&]() {
+            const Matrix44f& m = view_projection;
+            for (int n = 0; n < count; n++) {
+                const Vec4f& p = points[n];
+                reference[n] = Vec4f(
+                    p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+                    p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+                    p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2],
+                    p.x * m[0][3] + p.y * m[1][3] + p.z * m[2][3] + m[3][3]);
+            }
+        });
+        double kernel_seconds = measure_frame_seconds([&]() {
+            transform_points(view_projection, points, transformed.data(), count);
+        });
+        double copy_seconds = measure_frame_seconds([&]() {
+            memcpy(transformed.data(), points, count * sizeof(Vec4f));
+        });
+        transform_points(view_projection, points, transformed.data(), count);
+
+        float max_error = 0.0f;
+        for (int n = 0; n < count; n++) {
+            for (int i = 0; i < 4; i++) {
+                max_error = std::max(max_error, std::fabs(transformed[n][i] - reference[n][i]));
+            }
+        }
+
+        std::cout << "  " << grid.x << "x" << grid.y << ": loop " << bytes / loop_seconds / 1e9 <<
+            ", transform_points " << bytes / kernel_seconds / 1e9 << ", memcpy " <<
+            bytes / copy_seconds / 1e9 << " (max difference " << max_error << ")" << std::endl;
+    }
+}
+
+// Per-frame cost of a camera made of constants: rebuilt every frame as
+// before (double tan), rebuilt with the float functions, and taken from
+// bench_camera, which leaves only a 64-byte copy.
+static void bench_camera_update() {
+    const int updates = 1000;
+    Matrix44f result;
+    float sink = 0.0f;
+    // Read through a volatile so the rebuilt cameras can't be folded
+    volatile float fov = 45.0f;
+
+    double legacy_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < updates; i++) {
+            float b, t, l, r;
+            Matrix44f proj, view;
+            legacy_get_perspective_info(fov, 4.0f / 3.0f, 0.1f, b, t, l, r);
+            calc_proj_matrix(b, t, l, r, 0.1f, 100.0f, proj);
+            calc_lookat_matrix(Vec3f(0, 2, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0), view);
+            legacy_mult_matrices(view, proj, result);
+            sink += result[0][0];
+        }
+    });
+    double runtime_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < updates; i++) {
+            float b, t, l, r;
+            Matrix44f proj, view;
+            get_perspective_info(fov, 4.0f / 3.0f, 0.1f, 100.0f, b, t, l, r);
+            calc_proj_matrix(b, t, l, r, 0.1f, 100.0f, proj);
+            calc_lookat_matrix(Vec3f(0, 2, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0), view);
+            mult_matrices(view, proj, result);
+            sink += result[0][0];
+        }
+    });
+    double constant_seconds = measure_frame_seconds([&]() {
+        for (int i = 0; i < updates; i++) {
+            memcpy(result, bench_camera.matrix(), sizeof(result));
+            sink += result[0][0];
+        }
+    });
+    vector_sink = sink;
+
+    bench_view_projection(result);
+    std::cout << "camera: per-frame view-projection update, ns" << std::endl;
+    std::cout << "  double tan: " << legacy_seconds * 1e9 / updates << ", float: " <<
+        runtime_seconds * 1e9 / updates << ", constexpr: " << constant_seconds * 1e9 / updates <<
+        " (max difference " << max_matrix_difference(result, bench_camera.matrix()) << ")" << std::endl;
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "solver", bench_solver },
+    { "soa", bench_soa },
+    { "pins", bench_pins },
+    { "parallel", bench_parallel },
+    { "springs", bench_springs },
+    { "adaptive", bench_adaptive },
+    { "implicit", bench_implicit },
+    { "relaxation", bench_relaxation },
+    { "multigrid", bench_multigrid },
+    { "xpbd", bench_xpbd },
+    { "ordering", bench_ordering },
+    { "recorder", bench_recorder },
+    { "vectors", bench_vectors },
+    { "matrices", bench_matrices },
+    { "camera", bench_camera_update },
+};
+
+int run_benchmarks(const AppConfig& config) {
+    bool found = false;
+
+    if (config.grid_set) {
+        GridSize grid = { config.points_x, config.points_y };
+        bench_grids.assign(1, grid);
+    }
+
+    for (const Benchmark& bench : benchmarks) {
+        if (!config.bench_name.empty() && config.bench_name != bench.name) {
+            continue;
+        }
+        found = true;
+        bench.run();
+    }
+
+    if (!found) {
+        std::cout << "unknown benchmark: " << config.bench_name << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
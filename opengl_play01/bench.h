@@ -0,0 +1,9 @@
+#pragma once
+
+#include "config.h"
+
+// Runs the CPU benchmarks and prints the results to stdout. If
+// config.bench_name is empty every benchmark is run, otherwise only the
+// one with that name. An explicit grid size replaces the built-in grid
+// list. Returns the process exit code.
+int run_benchmarks(const AppConfig& config);
@@ -0,0 +1,219 @@
+#include "checkpoint.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+
+// Sections start on page boundaries so the mapped arrays are aligned and
+// the GL driver can read them without touching neighbouring sections.
+static const uint64_t CHECKPOINT_SECTION_ALIGN = 4096;
+
+static uint64_t align_up(uint64_t value) {
+    return (value + CHECKPOINT_SECTION_ALIGN - 1) & ~(CHECKPOINT_SECTION_ALIGN - 1);
+}
+
+// Whether count Ts at offset lie after the header and inside a file of
+// file_size bytes, aligned for T. Written so a crafted offset or count
+// can't overflow the comparison.
+template <typename T>
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t file_size) {
+    return offset >= sizeof(CheckpointHeader) && offset <= file_size &&
+        offset % alignof(T) == 0 && count <= (file_size - offset) / sizeof(T);
+}
+
+static bool write_section(FILE* file, uint64_t offset, const void* data, size_t bytes) {
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return fwrite(data, 1, bytes, file) == bytes;
+}
+
+bool write_checkpoint(
+    const char* path, int points_x, int points_y, unsigned iteration_index,
+    NodeOrder node_order, const SpringParams& params,
+    const Vec4f* positions, const Vec3f* velocities, const SpringTopology& topology) {
+
+    uint64_t points = (uint64_t)points_x * points_y;
+    uint64_t springs = (uint64_t)topology.springs();
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.header_size = sizeof(header);
+    header.points_x = points_x;
+    header.points_y = points_y;
+    header.iteration_index = iteration_index;
+    header.spring_count = (uint32_t)springs;
+    header.node_order = node_order;
+    header.t = params.t;
+    header.k = params.k;
+    header.c = params.c;
+    header.rest_length = params.rest_length;
+    header.pin_layout = params.pins;
+    header.pin_sway = params.pin_sway;
+    header.positions_offset = align_up(sizeof(header));
+    header.velocities_offset = align_up(header.positions_offset + points * sizeof(Vec4f));
+    header.offsets_offset = align_up(header.velocities_offset + points * sizeof(Vec3f));
+    header.neighbours_offset = align_up(header.offsets_offset + (points + 1) * sizeof(int32_t));
+    header.coeffs_offset = align_up(header.neighbours_offset + springs * sizeof(int32_t));
+    header.file_size = header.coeffs_offset + springs * sizeof(SpringCoeffs);
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        std::cout << "couldn't open " << tmp_path << " for writing" << std::endl;
+        return false;
+    }
+
+    bool ok = write_section(file, 0, &header, sizeof(header)) &&
+        write_section(file, header.positions_offset, positions, points * sizeof(Vec4f)) &&
+        write_section(file, header.velocities_offset, velocities, points * sizeof(Vec3f)) &&
+        write_section(file, header.offsets_offset, topology.offsets.data(), (points + 1) * sizeof(int32_t)) &&
+        write_section(file, header.neighbours_offset, topology.neighbours.data(), springs * sizeof(int32_t)) &&
+        write_section(file, header.coeffs_offset, topology.coeffs.data(), springs * sizeof(SpringCoeffs));
+    ok = (fflush(file) == 0) && ok;
+    ok = (fsync(fileno(file)) == 0) && ok;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(tmp_path.c_str(), path) != 0) {
+        std::cout << "failed to write checkpoint " << path << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+MappedCheckpoint::MappedCheckpoint()
+    : m_data(nullptr), m_size(0), m_header(nullptr) {
+}
+
+MappedCheckpoint::~MappedCheckpoint() {
+    close();
+}
+
+bool MappedCheckpoint::open(const char* path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cout << "couldn't open checkpoint " << path << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        std::cout << path << " is not a checkpoint" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "couldn't map checkpoint " << path << std::endl;
+        return false;
+    }
+
+    // The whole file is about to be streamed to the GPU.
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+
+    m_data = data;
+    m_size = (size_t)st.st_size;
+    m_header = (const CheckpointHeader*)data;
+
+    const CheckpointHeader& h = *m_header;
+    const char* error = nullptr;
+    uint64_t points = (uint64_t)h.points_x * h.points_y;
+    uint64_t springs = h.spring_count;
+
+    if (memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) != 0) {
+        error = "not a checkpoint";
+    }
+    else if (h.version != CHECKPOINT_VERSION || h.header_size != sizeof(CheckpointHeader)) {
+        error = "unsupported checkpoint version";
+    }
+    else if (h.node_order > ORDER_HILBERT) {
+        error = "unknown node order";
+    }
+    else if (h.pin_layout > PINS_TOP_CORNERS) {
+        error = "unknown pin layout";
+    }
+    else if (h.points_x < MIN_GRID_DIM || h.points_x > MAX_GRID_DIM ||
+             h.points_y < MIN_GRID_DIM || h.points_y > MAX_GRID_DIM ||
+             springs > INT_MAX || h.file_size != m_size ||
+             !section_fits<Vec4f>(h.positions_offset, points, m_size) ||
+             !section_fits<Vec3f>(h.velocities_offset, points, m_size) ||
+             !section_fits<int32_t>(h.offsets_offset, points + 1, m_size) ||
+             !section_fits<int32_t>(h.neighbours_offset, springs, m_size) ||
+             !section_fits<SpringCoeffs>(h.coeffs_offset, springs, m_size)) {
+        error = "truncated or corrupt checkpoint";
+    }
+
+    if (error) {
+        std::cout << path << ": " << error << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedCheckpoint::close() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+}
+
+SpringParams MappedCheckpoint::params() const {
+    SpringParams params;
+    params.t = m_header->t;
+    params.k = m_header->k;
+    params.c = m_header->c;
+    params.rest_length = m_header->rest_length;
+    params.pins = (PinLayout)m_header->pin_layout;
+    params.pin_sway = m_header->pin_sway;
+    return params;
+}
+
+const Vec4f* MappedCheckpoint::positions() const {
+    return (const Vec4f*)((const char*)m_data + m_header->positions_offset);
+}
+
+const Vec3f* MappedCheckpoint::velocities() const {
+    return (const Vec3f*)((const char*)m_data + m_header->velocities_offset);
+}
+
+bool MappedCheckpoint::read_topology(SpringTopology& topology) const {
+    const char* base = (const char*)m_data;
+    const int32_t* offsets = (const int32_t*)(base + m_header->offsets_offset);
+    const int32_t* neighbours = (const int32_t*)(base + m_header->neighbours_offset);
+    const SpringCoeffs* coeffs = (const SpringCoeffs*)(base + m_header->coeffs_offset);
+    int points = points_total();
+    int springs = (int)m_header->spring_count;
+
+    topology.offsets.assign(offsets, offsets + points + 1);
+    topology.neighbours.assign(neighbours, neighbours + springs);
+    topology.coeffs.assign(coeffs, coeffs + springs);
+
+    if (!topology.is_valid()) {
+        std::cout << "checkpoint has a corrupt spring graph" << std::endl;
+        return false;
+    }
+    return true;
+}
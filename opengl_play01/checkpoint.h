@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "node_ordering.h"
+#include "spring_mass_solver.h"
+#include "spring_topology.h"
+#include "vec_stuff.h"
+
+// On-disk snapshot of the simulation:
+//
+//   CheckpointHeader
+//   positions + mass   Vec4f[points]           (page aligned)
+//   velocities         Vec3f[points]           (page aligned)
+//   spring offsets     int32[points + 1]       (page aligned)
+//   spring neighbours  int32[springs]          (page aligned)
+//   spring coeffs      SpringCoeffs[springs]   (page aligned)
+//
+// Nodes are numbered in the header's node_order, with the pins of
+// pin_layout moved last (order_pins_last()).
+// Values are stored in native byte order (little-endian on everything we
+// build for) and in the same layout as the GL buffers, so a mapped file
+// can be handed straight to glBufferData().
+const char CHECKPOINT_MAGIC[8] = { 'S', 'P', 'R', 'M', 'C', 'K', 'P', 'T' };
+const uint32_t CHECKPOINT_VERSION = 5;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    int32_t points_x;
+    int32_t points_y;
+    uint32_t iteration_index;
+    uint32_t spring_count;
+    // NodeOrder the arrays are numbered in.
+    uint32_t node_order;
+    // PinLayout of SpringParams::pins.
+    uint32_t pin_layout;
+
+    float t;
+    float k;
+    float c;
+    float rest_length;
+    float pin_sway;
+
+    uint64_t positions_offset;
+    uint64_t velocities_offset;
+    uint64_t offsets_offset;
+    uint64_t neighbours_offset;
+    uint64_t coeffs_offset;
+    uint64_t file_size;
+};
+
+// Writes a checkpoint to path. The data goes to a temporary file that is
+// renamed over path at the end, so a crash mid-write never leaves a
+// truncated snapshot behind.
+bool write_checkpoint(
+    const char* path, int points_x, int points_y, unsigned iteration_index,
+    NodeOrder node_order, const SpringParams& params,
+    const Vec4f* positions, const Vec3f* velocities, const SpringTopology& topology);
+
+// A checkpoint mapped read-only into memory. The arrays point into the
+// mapping and stay valid until close() or destruction.
+class MappedCheckpoint {
+public:
+    MappedCheckpoint();
+    ~MappedCheckpoint();
+
+    MappedCheckpoint(const MappedCheckpoint&) = delete;
+    MappedCheckpoint& operator=(const MappedCheckpoint&) = delete;
+
+    // Maps the file and validates the header. Prints why on failure.
+    bool open(const char* path);
+    void close();
+
+    const CheckpointHeader& header() const { return *m_header; }
+    int points_total() const { return m_header->points_x * m_header->points_y; }
+
+    SpringParams params() const;
+
+    const Vec4f* positions() const;
+    const Vec3f* velocities() const;
+
+    // Copies the spring graph out of the mapping. Returns false if it
+    // doesn't hold together.
+    bool read_topology(SpringTopology& topology) const;
+
+private:
+    void* m_data;
+    size_t m_size;
+    const CheckpointHeader* m_header;
+};
@@ -0,0 +1,477 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <iostream>
+
+static bool parse_int(const std::string& str, int& value) {
+    char* end = nullptr;
+    long v = strtol(str.c_str(), &end, 10);
+    if (str.empty() || *end != '\0') {
+        return false;
+    }
+    value = (int)v;
+    return true;
+}
+
+static bool parse_float(const std::string& str, float& value) {
+    char* end = nullptr;
+    float v = strtof(str.c_str(), &end);
+    if (str.empty() || *end != '\0') {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+static bool parse_backend(const std::string& str, SimBackend& backend) {
+    if (str == "auto") {
+        backend = BACKEND_AUTO;
+    }
+    else if (str == "feedback") {
+        backend = BACKEND_FEEDBACK;
+    }
+    else if (str == "compute") {
+        backend = BACKEND_COMPUTE;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_grid(const std::string& str, int& x, int& y) {
+    size_t sep = str.find('x');
+    if (sep == std::string::npos) {
+        return false;
+    }
+    return parse_int(str.substr(0, sep), x) && parse_int(str.substr(sep + 1), y);
+}
+
+static bool check_grid(const AppConfig& config) {
+    if (config.points_x < MIN_GRID_DIM || config.points_x > MAX_GRID_DIM ||
+        config.points_y < MIN_GRID_DIM || config.points_y > MAX_GRID_DIM) {
+        std::cout << "grid must be between " << MIN_GRID_DIM << " and " << MAX_GRID_DIM <<
+            " points on each side" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+static bool parse_integrator(const std::string& str, SimIntegrator& integrator) {
+    if (str == "explicit") {
+        integrator = INTEGRATOR_EXPLICIT;
+    }
+    else if (str == "implicit") {
+        integrator = INTEGRATOR_IMPLICIT;
+    }
+    else if (str == "xpbd") {
+        integrator = INTEGRATOR_XPBD;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_solve(const std::string& str, ImplicitSolve& solve) {
+    if (str == "cg") {
+        solve = SOLVE_CG;
+    }
+    else if (str == "jacobi") {
+        solve = SOLVE_JACOBI;
+    }
+    else if (str == "gauss-seidel") {
+        solve = SOLVE_GAUSS_SEIDEL;
+    }
+    else if (str == "multigrid") {
+        solve = SOLVE_MULTIGRID;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static bool set_config_value(const std::string& key, const std::string& value, AppConfig& config) {
+    if (key == "grid") {
+        config.grid_set = true;
+        return parse_grid(value, config.points_x, config.points_y);
+    }
+    if (key == "points_x") {
+        config.grid_set = true;
+        return parse_int(value, config.points_x);
+    }
+    if (key == "points_y") {
+        config.grid_set = true;
+        return parse_int(value, config.points_y);
+    }
+    if (key == "headless") {
+        int headless;
+        if (!parse_int(value, headless)) {
+            return false;
+        }
+        config.headless = (headless != 0);
+        return true;
+    }
+    if (key == "frames") {
+        return parse_int(value, config.frames) && config.frames >= 0;
+    }
+    if (key == "dump_frame") {
+        config.dump_frame = value;
+        return true;
+    }
+    if (key == "profile") {
+        config.profile = value;
+        return true;
+    }
+    if (key == "restore") {
+        config.restore = value;
+        return true;
+    }
+    if (key == "checkpoint") {
+        config.checkpoint = value;
+        return true;
+    }
+    if (key == "checkpoint_interval") {
+        return parse_int(value, config.checkpoint_interval) && config.checkpoint_interval >= 0;
+    }
+    if (key == "readback") {
+        int readback;
+        if (!parse_int(value, readback)) {
+            return false;
+        }
+        config.readback = (readback != 0);
+        return true;
+    }
+    if (key == "record") {
+        config.record = value;
+        return true;
+    }
+    if (key == "record_error") {
+        return parse_float(value, config.record_error) && config.record_error > 0;
+    }
+    if (key == "record_keyframes") {
+        return parse_int(value, config.record_keyframes) && config.record_keyframes > 0;
+    }
+    if (key == "shear_k") {
+        return parse_float(value, config.shear_k) && config.shear_k >= 0;
+    }
+    if (key == "bend_k") {
+        return parse_float(value, config.bend_k) && config.bend_k >= 0;
+    }
+    if (key == "order") {
+        return parse_node_order(value.c_str(), config.node_order);
+    }
+    if (key == "pins") {
+        return parse_pin_layout(value.c_str(), config.pins);
+    }
+    if (key == "pin_sway") {
+        return parse_float(value, config.pin_sway) && config.pin_sway >= 0;
+    }
+    if (key == "step_rate") {
+        return parse_float(value, config.step_rate) && config.step_rate >= 0;
+    }
+    if (key == "max_catchup_steps") {
+        return parse_int(value, config.max_catchup_steps) && config.max_catchup_steps > 0;
+    }
+    if (key == "backend") {
+        return parse_backend(value, config.backend);
+    }
+    if (key == "fused_steps") {
+        return parse_int(value, config.fused_steps) &&
+            config.fused_steps >= 1 && config.fused_steps <= MAX_FUSED_STEPS;
+    }
+    if (key == "sim_thread") {
+        int sim_thread;
+        if (!parse_int(value, sim_thread)) {
+            return false;
+        }
+        config.sim_thread = (sim_thread != 0);
+        return true;
+    }
+    if (key == "adaptive") {
+        int adaptive;
+        if (!parse_int(value, adaptive)) {
+            return false;
+        }
+        config.adaptive = (adaptive != 0);
+        return true;
+    }
+    if (key == "integrator") {
+        return parse_integrator(value, config.integrator);
+    }
+    if (key == "solve") {
+        return parse_solve(value, config.solve);
+    }
+    if (key == "relax_weight") {
+        return parse_float(value, config.relax_weight) && config.relax_weight > 0;
+    }
+    if (key == "max_substeps") {
+        return parse_int(value, config.max_substeps) && config.max_substeps > 0;
+    }
+    if (key == "tick_rate") {
+        return parse_float(value, config.tick_rate) && config.tick_rate > 0;
+    }
+    if (key == "shader_dir") {
+        config.shader_dir = value;
+        return true;
+    }
+
+    std::cout << "unknown config key: " << key << std::endl;
+    return false;
+}
+
+bool load_config_file(const char* path, AppConfig& config) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "couldn't open the config file: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos ||
+            !set_config_value(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), config)) {
+            std::cout << path << ":" << line_number << ": bad setting: " << line << std::endl;
+            return false;
+        }
+    }
+
+    return check_grid(config);
+}
+
+static void print_usage(const char* program) {
+    std::cout << "usage: " << program << " [--grid WxH] [--config FILE] [--bench [NAME]]" << std::endl;
+    std::cout << "       [--headless] [--frames N] [--dump-frame FILE] [--shader-dir DIR]" << std::endl;
+    std::cout << "       [--profile FILE] [--restore FILE] [--checkpoint FILE]" << std::endl;
+    std::cout << "       [--checkpoint-interval N] [--readback] [--record FILE] [--record-error E]" << std::endl;
+    std::cout << "       [--record-keyframes N] [--shear K] [--bend K] [--order ORDER]" << std::endl;
+    std::cout << "       [--pins LAYOUT] [--pin-sway A]" << std::endl;
+    std::cout << "       [--step-rate HZ] [--max-catchup N] [--backend NAME] [--fused-steps N]" << std::endl;
+    std::cout << "       [--sim-thread] [--tick-rate HZ] [--adaptive] [--max-substeps N]" << std::endl;
+    std::cout << "       [--integrator NAME] [--solve NAME] [--relax-weight W]" << std::endl;
+}
+
+bool parse_args(int argc, const char* argv[], AppConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (strcmp(arg, "--grid") == 0 && has_value) {
+            if (!parse_grid(argv[++i], config.points_x, config.points_y)) {
+                std::cout << "bad grid size: " << argv[i] << std::endl;
+                return false;
+            }
+            config.grid_set = true;
+        }
+        else if (strcmp(arg, "--config") == 0 && has_value) {
+            if (!load_config_file(argv[++i], config)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--headless") == 0) {
+            config.headless = true;
+        }
+        else if (strcmp(arg, "--frames") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.frames) || config.frames < 0) {
+                std::cout << "bad frame count: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--dump-frame") == 0 && has_value) {
+            config.dump_frame = argv[++i];
+        }
+        else if (strcmp(arg, "--shader-dir") == 0 && has_value) {
+            config.shader_dir = argv[++i];
+        }
+        else if (strcmp(arg, "--profile") == 0 && has_value) {
+            config.profile = argv[++i];
+        }
+        else if (strcmp(arg, "--restore") == 0 && has_value) {
+            config.restore = argv[++i];
+        }
+        else if (strcmp(arg, "--checkpoint") == 0 && has_value) {
+            config.checkpoint = argv[++i];
+        }
+        else if (strcmp(arg, "--checkpoint-interval") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.checkpoint_interval) || config.checkpoint_interval < 0) {
+                std::cout << "bad checkpoint interval: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--readback") == 0) {
+            config.readback = true;
+        }
+        else if (strcmp(arg, "--record") == 0 && has_value) {
+            config.record = argv[++i];
+        }
+        else if (strcmp(arg, "--record-error") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.record_error) || !(config.record_error > 0)) {
+                std::cout << "bad record error bound: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--record-keyframes") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.record_keyframes) || config.record_keyframes <= 0) {
+                std::cout << "bad keyframe interval: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--shear") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.shear_k) || !(config.shear_k >= 0)) {
+                std::cout << "bad shear stiffness: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bend") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.bend_k) || !(config.bend_k >= 0)) {
+                std::cout << "bad bend stiffness: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--order") == 0 && has_value) {
+            if (!parse_node_order(argv[++i], config.node_order)) {
+                std::cout << "bad node order: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--pins") == 0 && has_value) {
+            if (!parse_pin_layout(argv[++i], config.pins)) {
+                std::cout << "bad pin layout: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--pin-sway") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.pin_sway) || !(config.pin_sway >= 0)) {
+                std::cout << "bad pin sway: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--step-rate") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.step_rate) || !(config.step_rate >= 0)) {
+                std::cout << "bad step rate: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--max-catchup") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.max_catchup_steps) || config.max_catchup_steps <= 0) {
+                std::cout << "bad catch-up limit: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--backend") == 0 && has_value) {
+            if (!parse_backend(argv[++i], config.backend)) {
+                std::cout << "bad backend: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--fused-steps") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.fused_steps) ||
+                config.fused_steps < 1 || config.fused_steps > MAX_FUSED_STEPS) {
+                std::cout << "fused steps must be between 1 and " << MAX_FUSED_STEPS << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--sim-thread") == 0) {
+            config.sim_thread = true;
+        }
+        else if (strcmp(arg, "--tick-rate") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.tick_rate) || !(config.tick_rate > 0)) {
+                std::cout << "bad tick rate: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--adaptive") == 0) {
+            config.adaptive = true;
+        }
+        else if (strcmp(arg, "--integrator") == 0 && has_value) {
+            if (!parse_integrator(argv[++i], config.integrator)) {
+                std::cout << "bad integrator: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--solve") == 0 && has_value) {
+            if (!parse_solve(argv[++i], config.solve)) {
+                std::cout << "bad solve: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--relax-weight") == 0 && has_value) {
+            if (!parse_float(argv[++i], config.relax_weight) || !(config.relax_weight > 0)) {
+                std::cout << "bad relaxation weight: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--max-substeps") == 0 && has_value) {
+            if (!parse_int(argv[++i], config.max_substeps) || config.max_substeps <= 0) {
+                std::cout << "bad substep limit: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench") == 0) {
+            config.bench = true;
+            if (has_value && argv[i + 1][0] != '-') {
+                config.bench_name = argv[++i];
+            }
+        }
+        else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (config.checkpoint_interval && config.checkpoint.empty()) {
+        std::cout << "--checkpoint-interval needs --checkpoint" << std::endl;
+        return false;
+    }
+
+    // The GL buffers only hold interpolated positions in that mode.
+    if (config.sim_thread && (!config.restore.empty() || !config.checkpoint.empty())) {
+        std::cout << "checkpoints don't work with --sim-thread" << std::endl;
+        return false;
+    }
+
+    // The step size is chosen from positions only the CPU solver has.
+    if (config.adaptive && !config.sim_thread) {
+        std::cout << "--adaptive needs --sim-thread" << std::endl;
+        return false;
+    }
+
+    if (config.integrator != INTEGRATOR_EXPLICIT && (!config.sim_thread || config.adaptive)) {
+        std::cout << "--integrator needs --sim-thread and no --adaptive" << std::endl;
+        return false;
+    }
+
+    if ((config.solve != SOLVE_CG || config.relax_weight != 1.0f) &&
+        config.integrator != INTEGRATOR_IMPLICIT) {
+        std::cout << "--solve and --relax-weight need --integrator implicit" << std::endl;
+        return false;
+    }
+
+    return check_grid(config);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <string>
+
+#include "implicit_solver.h"
+#include "node_ordering.h"
+#include "pin_set.h"
+
+const int MIN_GRID_DIM = 2;
+const int MAX_GRID_DIM = 16384;
+
+// How the update pass runs on the GPU. Auto uses compute shaders when the
+// context is GL 4.3 or better and transform feedback otherwise; the
+// default stays transform feedback.
+enum SimBackend {
+    BACKEND_AUTO,
+    BACKEND_FEEDBACK,
+    BACKEND_COMPUTE
+};
+
+// How the simulation thread integrates the cloth on the CPU.
+enum SimIntegrator {
+    INTEGRATOR_EXPLICIT,
+    INTEGRATOR_IMPLICIT,
+    INTEGRATOR_XPBD
+};
+
+const int DEFAULT_FUSED_STEPS = 4;
+const int MAX_FUSED_STEPS = 16;
+
+// 16 steps per frame at 60 fps, the speed the demo was tuned at.
+const float DEFAULT_STEP_RATE = 960.0f;
+const int DEFAULT_MAX_CATCHUP_STEPS = 64;
+
+// Run-time settings. Filled from the command line, which may in turn name
+// a config file of "key = value" lines (see load_config_file()).
+struct AppConfig {
+    int points_x;
+    int points_y;
+
+    // Set when --grid or a grid key was given explicitly.
+    bool grid_set;
+
+    bool bench;
+    std::string bench_name;
+
+    // Render through an EGL context and an offscreen framebuffer instead
+    // of a GLFW window.
+    bool headless;
+    // Frames to run before exiting; 0 runs until the window is closed
+    // (or DEFAULT_HEADLESS_FRAMES when headless).
+    int frames;
+    // Headless only: write the last frame to this PPM file.
+    std::string dump_frame;
+
+    // When set, profile every frame and write a Chrome trace here.
+    std::string profile;
+
+    // Start from this checkpoint instead of a fresh cloth.
+    std::string restore;
+    // Save the state here on exit, and every checkpoint_interval frames
+    // if that is non-zero.
+    std::string checkpoint;
+    int checkpoint_interval;
+
+    // Read positions back to the CPU every frame and report the latency.
+    // Recording does this too.
+    bool readback;
+
+    // When set, stream every frame's positions to this trajectory file,
+    // quantized to within record_error.
+    std::string record;
+    float record_error;
+    int record_keyframes;
+
+    // Stiffness of the diagonal (shear) and skip-one (bend) springs; 0
+    // leaves them out.
+    float shear_k;
+    float bend_k;
+
+    // Node numbering used on the GPU. Exports stay row-major.
+    NodeOrder node_order;
+
+    // Which nodes are held, and how far along x they sway; 0 keeps them
+    // still.
+    PinLayout pins;
+    float pin_sway;
+
+    // Solver steps per second of real time; frames run however many are
+    // due. 0 runs a fixed iterations_per_frame steps every frame instead.
+    float step_rate;
+    // Most steps one frame may run to catch up; time owed beyond that is
+    // dropped.
+    int max_catchup_steps;
+
+    SimBackend backend;
+    // Run the cloth on the CPU on its own thread at tick_rate ticks per
+    // second; the GPU only draws it.
+    bool sim_thread;
+    float tick_rate;
+    // Sim thread: pick each tick's substep count and size from how stiff
+    // and fast the cloth is, up to max_substeps, instead of a fixed 16.
+    bool adaptive;
+    int max_substeps;
+    // Sim thread: explicit substeps (the default), one backward Euler
+    // step per tick, or XPBD substeps.
+    SimIntegrator integrator;
+    // Implicit integrator: how each step's linear system is solved, and
+    // the relaxation weight for Jacobi and Gauss-Seidel.
+    ImplicitSolve solve;
+    float relax_weight;
+    // Compute backend: substeps run per dispatch out of shared memory.
+    int fused_steps;
+
+    // Directory holding springmass/*.glsl.
+    std::string shader_dir;
+
+    AppConfig()
+        : points_x(50), points_y(50), grid_set(false), bench(false),
+          headless(false), frames(0), checkpoint_interval(0),
+          readback(false), record_error(1e-3f), record_keyframes(60),
+          shear_k(0.0f), bend_k(0.0f), node_order(ORDER_ROW_MAJOR),
+          pins(PINS_TOP_ROW), pin_sway(0.0f),
+          step_rate(DEFAULT_STEP_RATE), max_catchup_steps(DEFAULT_MAX_CATCHUP_STEPS),
+          backend(BACKEND_FEEDBACK), sim_thread(false), tick_rate(60.0f),
+          adaptive(false), max_substeps(64), integrator(INTEGRATOR_EXPLICIT),
+          solve(SOLVE_CG), relax_weight(1.0f),
+          fused_steps(DEFAULT_FUSED_STEPS), shader_dir("../../../shaders") {
+    }
+
+    int points_total() const { return points_x * points_y; }
+};
+
+const int DEFAULT_HEADLESS_FRAMES = 600;
+
+// Understands:
+//   --grid WxH         cloth resolution (default 50x50)
+//   --config FILE      read settings from FILE, later flags override it
+//   --bench [NAME]     run the CPU benchmarks instead of the demo
+//   --headless         render offscreen, no window needed
+//   --frames N         stop after N frames
+//   --dump-frame FILE  save the final headless frame as a PPM
+//   --shader-dir DIR   where to load the shaders from
+//   --profile FILE     time each render phase, write a Chrome trace
+//   --restore FILE     resume from a checkpoint (its grid size wins)
+//   --checkpoint FILE  save a checkpoint on exit
+//   --checkpoint-interval N  ... and every N frames
+//   --readback         read positions back each frame, report latency
+//   --record FILE      stream positions to a trajectory file
+//   --record-error E   ... quantized to within E (default 0.001)
+//   --record-keyframes N  ... with a keyframe every N frames
+//   --shear K          add diagonal springs of stiffness K
+//   --bend K           add skip-one springs of stiffness K
+//   --order ORDER      number nodes row, morton or hilbert
+//   --pins LAYOUT      hold the top row (default) or just its corners
+//   --pin-sway A       swing the pins A either way along x
+//   --step-rate HZ     solver steps per second (default 960, 0 = 16 a frame)
+//   --max-catchup N    most steps one frame may run (default 64)
+//   --backend NAME     feedback (default), compute or auto
+//   --fused-steps N    compute substeps per dispatch (default 4)
+//   --sim-thread       simulate on a CPU thread, render interpolated
+//   --tick-rate HZ     ... at HZ ticks per second (default 60)
+//   --adaptive         ... choosing substeps per tick from the cloth's state
+//   --max-substeps N   ... up to N a tick (default 64)
+//   --integrator NAME  ... with explicit (default), implicit or xpbd steps
+//   --solve NAME       implicit solve: cg (default), jacobi, gauss-seidel
+//                      or multigrid
+//   --relax-weight W   ... relaxation weight, >1 over-relaxes (default 1)
+// Prints a message and returns false on bad input.
+bool parse_args(int argc, const char* argv[], AppConfig& config);
+
+// Keys: points_x, points_y, grid (WxH), headless (0/1), frames,
+// dump_frame, shader_dir, profile, restore, checkpoint,
+// checkpoint_interval, readback (0/1), record, record_error, record_keyframes, shear_k,
+// bend_k, order, pins, pin_sway, step_rate, max_catchup_steps, backend, fused_steps,
+// sim_thread (0/1), tick_rate, adaptive (0/1), max_substeps, integrator, solve, relax_weight.
+// '#' starts a comment.
+bool load_config_file(const char* path, AppConfig& config);
@@ -0,0 +1,36 @@
+#include "fixed_step_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+FixedStepScheduler::FixedStepScheduler(double step_seconds, int max_steps_per_update)
+    : m_step_seconds(step_seconds), m_max_steps_per_update(max_steps_per_update),
+      m_accumulator(0), m_updates(0), m_steps_run(0), m_capped_updates(0),
+      m_seconds_dropped(0) {
+}
+
+int FixedStepScheduler::advance(double elapsed_seconds) {
+    m_accumulator += std::max(elapsed_seconds, 0.0);
+    m_updates++;
+
+    int steps = (int)std::min(m_accumulator / m_step_seconds, (double)m_max_steps_per_update);
+    m_accumulator -= steps * m_step_seconds;
+
+    // Anything still owed past the cap is given up, keeping the fraction
+    // of a step that would have carried over anyway.
+    if (steps == m_max_steps_per_update && m_accumulator >= m_step_seconds) {
+        double keep = fmod(m_accumulator, m_step_seconds);
+        m_seconds_dropped += m_accumulator - keep;
+        m_accumulator = keep;
+        m_capped_updates++;
+    }
+
+    m_steps_run += steps;
+    return steps;
+}
+
+void FixedStepScheduler::print_stats(std::ostream& out, double elapsed_seconds) const {
+    out << m_steps_run << " steps (" << m_steps_run / elapsed_seconds << "/s, " <<
+        (m_updates ? (double)m_steps_run / m_updates : 0.0) << " per update), " <<
+        m_seconds_dropped << " s dropped over " << m_capped_updates << " capped updates" << std::endl;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Turns elapsed wall-clock time into a whole number of fixed-size solver
+// steps. Time accumulates across updates and each update consumes as many
+// steps as fit; the remainder carries over. When a slow frame leaves more
+// than max_steps_per_update steps owed, the extra time is dropped instead
+// of being caught up, so one slow frame can't make the next one slower
+// still.
+class FixedStepScheduler {
+public:
+    FixedStepScheduler(double step_seconds, int max_steps_per_update);
+
+    // Adds elapsed_seconds of real time and returns the steps to run now.
+    int advance(double elapsed_seconds);
+
+    // How far the accumulator is into the next step, in [0, 1).
+    double alpha() const { return m_accumulator / m_step_seconds; }
+
+    double step_seconds() const { return m_step_seconds; }
+
+    uint64_t updates() const { return m_updates; }
+    uint64_t steps_run() const { return m_steps_run; }
+    // Updates that hit max_steps_per_update and dropped time.
+    uint64_t capped_updates() const { return m_capped_updates; }
+    double seconds_dropped() const { return m_seconds_dropped; }
+
+    void print_stats(std::ostream& out, double elapsed_seconds) const;
+
+private:
+    double m_step_seconds;
+    int m_max_steps_per_update;
+    double m_accumulator;
+
+    uint64_t m_updates;
+    uint64_t m_steps_run;
+    uint64_t m_capped_updates;
+    double m_seconds_dropped;
+};
@@ -95,10 +95,10 @@ bool get_file_content(const std::string& path, std::string& content) {
     return true;
 }
 
-GLuint load_shader(const char* shader_file, GLenum shader_type) {
+GLuint load_shader(const char* shader_file, GLenum shader_type, const char* defines) {
 
-    const char* shader_type_str = (shader_type == GL_VERTEX_SHADER) ?
-        "vert" : "frag";
+    const char* shader_type_str = (shader_type == GL_VERTEX_SHADER) ? "vert" :
+        (shader_type == GL_COMPUTE_SHADER) ? "comp" : "frag";
 
     std::string shader_src;
     if (!get_file_content(shader_file, shader_src)) {
@@ -107,6 +107,11 @@ GLuint load_shader(const char* shader_file, GLenum shader_type) {
         exit(-1);
     }
 
+    if (defines) {
+        size_t line_end = shader_src.find('\n');
+        shader_src.insert(line_end == std::string::npos ? shader_src.size() : line_end + 1, defines);
+    }
+
     const char* shader_src_cstr = shader_src.c_str();
     GLint compile_status;
 
@@ -157,117 +162,34 @@ GLuint make_prog(const char* vert_shader_file, const char* frag_shader_file) {
     return prog;
 }
 
-GLint get_uniform_loc(GLuint prog, const char* name) {
-    GLint loc = glGetUniformLocation(prog, name);
-    if (loc == -1) {
-        std::cout << "couldn't get the uniform for " << name << std::endl;
-        exit(-1);
-    }
-    return loc;
-}
+GLuint make_compute_prog(const char* comp_shader_file, const char* defines) {
 
-void get_identity_matrix(Matrix44f& result) {
-    memset(result, 0, sizeof(result));
-    for (int i = 0; i < 4; i++) {
-        result[i][i] = 1;
-    }
-}
-
-void mult_matrices(
-    const Matrix44f& m1, const Matrix44f& m2,
-    Matrix44f& result) {
+    GLuint prog = glCreateProgram();
 
-    Matrix44f tmp_result = {0};
+    GLuint cs = load_shader(comp_shader_file, GL_COMPUTE_SHADER, defines);
 
-    for (int x = 0; x < 4; x++) {
-        for (int y = 0; y < 4; y++) {
-            for (int i = 0; i < 4; i++) {
-                tmp_result[x][y] += m1[x][i] * m2[i][y];
-            }
-        }
+    glAttachShader(prog, cs);
+    if (check_gl_err()) {
+        print_shader_log(cs, comp_shader_file);
+        return 0;
     }
 
-    memcpy(result, tmp_result, sizeof(result));
-}
-
-void add_y_rotation_to_matrix(Matrix44f& m, float rot) {
-    Matrix44f rot_matrix;
-    get_identity_matrix(rot_matrix);
-
-    float s = sin(rot);
-    float c = cos(rot);
-
-    rot_matrix[0][0] = c;
-    rot_matrix[2][0] = s;
-    rot_matrix[0][2] = -s;
-    rot_matrix[2][2] = c;
-
-    mult_matrices(m, rot_matrix, m);
-}
-
-void get_perspective_info(
-    float fov, float aspect_ratio, float near, float far,
-    float& b, float& t, float& l, float& r)
-{
-    float scale = tan(fov * 0.5 * PI / 180) * near;
-    r = aspect_ratio * scale;
-    l = -r;
-    t = scale;
-    b = -t;
-}
+    GLint link_status;
+    glLinkProgram(prog);
+    glGetProgramiv(prog, GL_LINK_STATUS, &link_status);
+    if (check_gl_err() || link_status == GL_FALSE) {
+        print_program_log(prog);
+        return 0;
+    }
 
-void calc_proj_matrix(
-    float b, float t, float l, float r, float n, float f,
-    Matrix44f& mat)
-{
-    // set OpenGL perspective projection matrix
-    mat[0][0] = 2 * n / (r - l);
-    mat[0][1] = 0;
-    mat[0][2] = 0;
-    mat[0][3] = 0;
-
-    mat[1][0] = 0;
-    mat[1][1] = 2 * n / (t - b);
-    mat[1][2] = 0;
-    mat[1][3] = 0;
-
-    mat[2][0] = (r + l) / (r - l);
-    mat[2][1] = (t + b) / (t - b);
-    mat[2][2] = -(f + n) / (f - n);
-    mat[2][3] = -1;
-
-    mat[3][0] = 0;
-    mat[3][1] = 0;
-    mat[3][2] = -2 * f * n / (f - n);
-    mat[3][3] = 0;
+    return prog;
 }
 
-void calc_lookat_matrix(
-    const Vec3f& pos, const Vec3f& at, const Vec3f& up,
-    Matrix44f& mat) {
-
-    Vec3f z_axis = (pos - at).norm();
-
-    Vec3f x_axis = up.cross(z_axis).norm();
-    Vec3f y_axis = z_axis.cross(x_axis);
-
-    mat[0][0] = x_axis.x;
-    mat[1][0] = x_axis.y;
-    mat[2][0] = x_axis.z;
-    mat[3][0] = x_axis.dot(pos) * -1.0f;
-
-    mat[0][1] = y_axis.x;
-    mat[1][1] = y_axis.y;
-    mat[2][1] = y_axis.z;
-    mat[3][1] = y_axis.dot(pos) * -1.0f;
-
-    mat[0][2] = z_axis.x;
-    mat[1][2] = z_axis.y;
-    mat[2][2] = z_axis.z;
-    mat[3][2] = z_axis.dot(pos) * -1.0f;
-
-    mat[0][3] = 0;
-    mat[1][3] = 0;
-    mat[2][3] = 0;
-    mat[3][3] = 1;
+GLint get_uniform_loc(GLuint prog, const char* name) {
+    GLint loc = glGetUniformLocation(prog, name);
+    if (loc == -1) {
+        std::cout << "couldn't get the uniform for " << name << std::endl;
+        exit(-1);
+    }
+    return loc;
 }
@@ -0,0 +1,213 @@
+#include "headless_context.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <iostream>
+#include <vector>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HAVE_EGL 1
+#else
+#define HAVE_EGL 0
+#endif
+
+HeadlessContext::HeadlessContext()
+    : m_display(nullptr), m_context(nullptr), m_surface(nullptr),
+      m_fbo(0), m_color_rb(0), m_depth_rb(0), m_width(0), m_height(0) {
+}
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+#if HAVE_EGL
+
+static bool has_extension(const char* extensions, const char* name) {
+    if (!extensions) {
+        return false;
+    }
+
+    size_t len = strlen(name);
+    for (const char* p = strstr(extensions, name); p; p = strstr(p + len, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static EGLDisplay get_display() {
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool HeadlessContext::create(int major, int minor) {
+    EGLDisplay display = get_display();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cout << "Failed to initialize EGL" << std::endl;
+        return false;
+    }
+    m_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "EGL has no desktop OpenGL support" << std::endl;
+        return false;
+    }
+
+    bool surfaceless = has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+        std::cout << "No suitable EGL config" << std::endl;
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, major,
+        EGL_CONTEXT_MINOR_VERSION, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+        EGL_NONE
+    };
+
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        std::cout << "Failed to create an OpenGL " << major << "." << minor << " EGL context" << std::endl;
+        return false;
+    }
+    m_context = context;
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH, 1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+        if (surface == EGL_NO_SURFACE) {
+            std::cout << "Failed to create an EGL pbuffer" << std::endl;
+            return false;
+        }
+        m_surface = surface;
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        std::cout << "Failed to make the EGL context current" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void HeadlessContext::destroy() {
+    if (!m_display) {
+        return;
+    }
+
+    if (m_fbo) {
+        glDeleteFramebuffers(1, &m_fbo);
+        glDeleteRenderbuffers(1, &m_color_rb);
+        glDeleteRenderbuffers(1, &m_depth_rb);
+        m_fbo = m_color_rb = m_depth_rb = 0;
+    }
+
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_surface) {
+        eglDestroySurface(m_display, m_surface);
+    }
+    if (m_context) {
+        eglDestroyContext(m_display, m_context);
+    }
+    eglTerminate(m_display);
+
+    m_display = m_context = m_surface = nullptr;
+}
+
+#else
+
+bool HeadlessContext::create(int, int) {
+    std::cout << "Headless mode needs EGL, which this build doesn't have" << std::endl;
+    return false;
+}
+
+void HeadlessContext::destroy() {
+}
+
+#endif
+
+bool HeadlessContext::create_framebuffer(int width, int height) {
+    glGenRenderbuffers(1, &m_color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_color_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &m_depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_rb);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_rb);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void HeadlessContext::swap_buffers() {
+    glFlush();
+}
+
+bool HeadlessContext::save_frame(const char* path) {
+    std::vector<unsigned char> pixels((size_t)m_width * m_height * 3);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        std::cout << "couldn't open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", m_width, m_height);
+    // GL rows start at the bottom, PPM rows at the top.
+    for (int y = m_height - 1; y >= 0; y--) {
+        fwrite(&pixels[(size_t)y * m_width * 3], 1, (size_t)m_width * 3, file);
+    }
+    fclose(file);
+
+    return true;
+}
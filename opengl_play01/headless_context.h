@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// An OpenGL core context with no window, for display-less machines. It is
+// created through EGL, surfaceless when the driver allows it (Mesa's
+// llvmpipe does) and on a 1x1 pbuffer otherwise, and then renders into an
+// FBO of the requested size that stays bound as the default target.
+//
+// Only built where EGL exists; elsewhere create() just reports failure.
+// GLEW has to be built with EGL support (GLEW_EGL) for glewInit() to
+// work on such a context.
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // Creates the context and makes it current.
+    bool create(int major, int minor);
+
+    // Creates and binds the offscreen framebuffer. Needs a current
+    // context with GL entry points loaded, i.e. call after glewInit().
+    bool create_framebuffer(int width, int height);
+
+    void destroy();
+
+    // Stands in for glfwSwapBuffers(): makes sure the frame is submitted.
+    void swap_buffers();
+
+    // Writes the colour buffer to a binary PPM file.
+    bool save_frame(const char* path);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+private:
+    void* m_display;
+    void* m_context;
+    void* m_surface;
+
+    GLuint m_fbo;
+    GLuint m_color_rb;
+    GLuint m_depth_rb;
+    int m_width;
+    int m_height;
+};
@@ -0,0 +1,967 @@
+#include "implicit_solver.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+// Nodes per parallel block. Small enough that the 2K-node grids still
+// split across a few threads, big enough to amortise the task overhead.
+static const int block_nodes = 2048;
+
+static int block_count(int nodes) {
+    return (nodes + block_nodes - 1) / block_nodes;
+}
+
+// Calls func(block, begin, end) for every block of nodes, on pool when
+// there is one.
+template <typename Func>
+static void run_blocks(ThreadPool* pool, int nodes, Func func) {
+    int blocks = block_count(nodes);
+    auto run = [&](int block) {
+        int begin = block * block_nodes;
+        func(block, begin, std::min(begin + block_nodes, nodes));
+    };
+
+    if (pool) {
+        pool->parallel_for(blocks, run);
+    }
+    else {
+        for (int block = 0; block < blocks; block++) {
+            run(block);
+        }
+    }
+}
+
+static double sum_partials(const std::vector<double>& partials) {
+    double sum = 0;
+    for (double partial : partials) {
+        sum += partial;
+    }
+    return sum;
+}
+
+// One level's linear system A dv = rhs, where A is diag(damped_mass) plus
+// every spring's t^2 J block, as views of its arrays.
+struct SpringSystem {
+    int points_x;
+    int points_y;
+    const SpringTopology* topology;
+    const SpringJacobian* jacobians;
+    const float* damped_mass;
+    const float* inv_diagonal;
+    const int* color_nodes;
+    const int* color_offsets;
+    int color_count;
+    float* dv;
+    float* rhs;
+    float* residual;
+
+    int nodes() const { return points_x * points_y; }
+};
+
+// Row n of A dv into q, and the off-diagonals of A's own 3x3 block at n.
+static inline void node_product(const SpringSystem& system, int n, float* q, Vec3f& block) {
+    const SpringTopology& topology = *system.topology;
+    const float* dvn = system.dv + n * 3;
+    q[0] = system.damped_mass[n] * dvn[0];
+    q[1] = system.damped_mass[n] * dvn[1];
+    q[2] = system.damped_mass[n] * dvn[2];
+    block = Vec3f(0, 0, 0);
+
+    for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+        const float* dvo = system.dv + topology.neighbours[s] * 3;
+        const SpringJacobian& J = system.jacobians[s];
+        float dx = dvn[0] - dvo[0];
+        float dy = dvn[1] - dvo[1];
+        float dz = dvn[2] - dvo[2];
+        q[0] += J.xx * dx + J.xy * dy + J.xz * dz;
+        q[1] += J.xy * dx + J.yy * dy + J.yz * dz;
+        q[2] += J.xz * dx + J.yz * dy + J.zz * dz;
+        block += Vec3f(J.xy, J.xz, J.yz);
+    }
+}
+
+// One Gauss-Seidel sweep: each colour in turn (last to first when
+// reverse), each node's x, y and z relaxed against the latest values. No
+// spring joins two nodes of a colour, so a colour's nodes update in place
+// in parallel. Returns the preconditioned residual summed along the way,
+// each node's just before its update, so only close to the exact one.
+static double relax_colors(ThreadPool* pool, const SpringSystem& system, float w, bool reverse,
+    std::vector<double>& partials) {
+
+    double rz = 0;
+
+    for (int i = 0; i < system.color_count; i++) {
+        int color = reverse ? system.color_count - 1 - i : i;
+        const int* color_nodes = system.color_nodes + system.color_offsets[color];
+        int count = system.color_offsets[color + 1] - system.color_offsets[color];
+
+        run_blocks(pool, count, [&](int block, int begin, int end) {
+            double block_rz = 0;
+            for (int i = begin; i < end; i++) {
+                int n = color_nodes[i];
+                float* dvn = system.dv + n * 3;
+                const float* inv = system.inv_diagonal + n * 3;
+                const float* b = system.rhs + n * 3;
+
+                float q[3];
+                Vec3f block;
+                node_product(system, n, q, block);
+
+                float rx = b[0] - q[0];
+                float ry = b[1] - q[1];
+                float rz_n = b[2] - q[2];
+                block_rz += rx * inv[0] * rx + ry * inv[1] * ry + rz_n * inv[2] * rz_n;
+
+                float ddx = w * inv[0] * rx;
+                ry -= block.x * ddx;
+                rz_n -= block.y * ddx;
+                float ddy = w * inv[1] * ry;
+                rz_n -= block.z * ddy;
+                float ddz = w * inv[2] * rz_n;
+                dvn[0] += ddx;
+                dvn[1] += ddy;
+                dvn[2] += ddz;
+            }
+            partials[block] = block_rz;
+        });
+
+        for (int block = 0; block < block_count(count); block++) {
+            rz += partials[block];
+        }
+    }
+
+    return rz;
+}
+
+// residual = rhs - A dv, zero at fixed nodes.
+static void compute_residual(ThreadPool* pool, const SpringSystem& system) {
+    run_blocks(pool, system.nodes(), [&](int, int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            float* r = system.residual + n * 3;
+            if (system.inv_diagonal[n * 3] == 0.0f) {
+                r[0] = r[1] = r[2] = 0.0f;
+                continue;
+            }
+
+            float q[3];
+            Vec3f block;
+            node_product(system, n, q, block);
+            r[0] = system.rhs[n * 3] - q[0];
+            r[1] = system.rhs[n * 3 + 1] - q[1];
+            r[2] = system.rhs[n * 3 + 2] - q[2];
+        }
+    });
+}
+
+// Rows or columns of the next level down from count of them: every
+// other one plus the last. Two or fewer are left as they are.
+static int coarse_count(int count) {
+    return count > 2 ? count / 2 + 1 : count;
+}
+
+// Fine row or column of coarse one, between levels count and
+// coarse_count wide.
+static int fine_point(int coarse, int count, int coarse_count) {
+    return coarse_count == count ? coarse : std::min(2 * coarse, count - 1);
+}
+
+// The one or two coarse rows or columns fine is interpolated from, out of
+// a level count wide, and their weights. Returns how many.
+static int interpolation_points(int fine, int count, int* coarse, float* weights) {
+    if (coarse_count(count) == count) {
+        coarse[0] = fine;
+        weights[0] = 1.0f;
+        return 1;
+    }
+    if (fine == count - 1 || fine % 2 == 0) {
+        coarse[0] = fine == count - 1 ? count / 2 : fine / 2;
+        weights[0] = 1.0f;
+        return 1;
+    }
+    coarse[0] = fine / 2;
+    coarse[1] = fine / 2 + 1;
+    weights[0] = weights[1] = 0.5f;
+    return 2;
+}
+
+// Weight of coarse row or column coarse in fine's interpolation.
+static float interpolation_weight(int fine, int coarse, int count) {
+    int points[2];
+    float weights[2];
+    if (fine < 0 || fine >= count) {
+        return 0.0f;
+    }
+    int found = interpolation_points(fine, count, points, weights);
+    for (int i = 0; i < found; i++) {
+        if (points[i] == coarse) {
+            return weights[i];
+        }
+    }
+    return 0.0f;
+}
+
+// Sorts topology's nodes by colour into color_nodes, keeping node order
+// within a colour; colour i is [color_offsets[i], color_offsets[i + 1]).
+static void sort_by_color(const SpringTopology& topology, std::vector<int>& color_nodes,
+    std::vector<int>& color_offsets) {
+
+    std::vector<int> colors;
+    int color_count = ::color_nodes(topology, colors);
+    color_offsets.assign(color_count + 1, 0);
+    for (int color : colors) {
+        color_offsets[color + 1]++;
+    }
+    for (int c = 0; c < color_count; c++) {
+        color_offsets[c + 1] += color_offsets[c];
+    }
+
+    std::vector<int> next(color_offsets.begin(), color_offsets.end() - 1);
+    color_nodes.resize(topology.nodes());
+    for (int n = 0; n < topology.nodes(); n++) {
+        color_nodes[next[colors[n]]++] = n;
+    }
+}
+
+// Takes the pinned nodes out of sort_by_color()'s lists, keeping the
+// colours' order.
+static void drop_pinned(const PinSet& pins, std::vector<int>& color_nodes,
+    std::vector<int>& color_offsets) {
+
+    int kept = 0;
+    int begin = 0;
+    for (size_t color = 0; color + 1 < color_offsets.size(); color++) {
+        int end = color_offsets[color + 1];
+        for (int i = begin; i < end; i++) {
+            if (!pins.is_pinned(color_nodes[i])) {
+                color_nodes[kept++] = color_nodes[i];
+            }
+        }
+        begin = end;
+        color_offsets[color + 1] = kept;
+    }
+    color_nodes.resize(kept);
+}
+
+// The element-wise halves of a CG iteration, over floats [begin, end) of
+// the interleaved vectors. update_solution steps dv and r along p and q,
+// preconditions r into z and returns r . z; update_direction makes the
+// next search direction.
+typedef double (*UpdateSolutionFunc)(
+    float* dv, float* r, float* z, const float* p, const float* q,
+    const float* inv_diagonal, float alpha, int begin, int end);
+typedef void (*UpdateDirectionFunc)(float* p, const float* z, float beta, int begin, int end);
+
+static double update_solution_scalar(
+    float* dv, float* r, float* z, const float* p, const float* q,
+    const float* inv_diagonal, float alpha, int begin, int end) {
+
+    double rz = 0;
+    for (int i = begin; i < end; i++) {
+        dv[i] += alpha * p[i];
+        r[i] -= alpha * q[i];
+        z[i] = inv_diagonal[i] * r[i];
+        rz += r[i] * z[i];
+    }
+    return rz;
+}
+
+static void update_direction_scalar(float* p, const float* z, float beta, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        p[i] = z[i] + beta * p[i];
+    }
+}
+
+#if HAVE_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static double update_solution_avx2(
+    float* dv, float* r, float* z, const float* p, const float* q,
+    const float* inv_diagonal, float alpha, int begin, int end) {
+
+    const __m256 a = _mm256_set1_ps(alpha);
+    __m256 rz = _mm256_setzero_ps();
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 ri = _mm256_fnmadd_ps(a, _mm256_loadu_ps(q + i), _mm256_loadu_ps(r + i));
+        __m256 zi = _mm256_mul_ps(_mm256_loadu_ps(inv_diagonal + i), ri);
+        _mm256_storeu_ps(dv + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(p + i), _mm256_loadu_ps(dv + i)));
+        _mm256_storeu_ps(r + i, ri);
+        _mm256_storeu_ps(z + i, zi);
+        rz = _mm256_fmadd_ps(ri, zi, rz);
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, rz);
+    double sum = 0;
+    for (float lane : lanes) {
+        sum += lane;
+    }
+
+    return sum + update_solution_scalar(dv, r, z, p, q, inv_diagonal, alpha, i, end);
+}
+
+__attribute__((target("avx2,fma")))
+static void update_direction_avx2(float* p, const float* z, float beta, int begin, int end) {
+    const __m256 b = _mm256_set1_ps(beta);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        _mm256_storeu_ps(p + i, _mm256_fmadd_ps(b, _mm256_loadu_ps(p + i), _mm256_loadu_ps(z + i)));
+    }
+
+    update_direction_scalar(p, z, beta, i, end);
+}
+
+#endif
+
+// Both x86 levels share the AVX2 loops: they are bandwidth bound, and
+// wider vectors don't move more bytes.
+static UpdateSolutionFunc get_update_solution(SimdLevel level) {
+#if HAVE_X86_KERNELS
+    if (level != SIMD_SCALAR) {
+        return update_solution_avx2;
+    }
+#endif
+    return update_solution_scalar;
+}
+
+static UpdateDirectionFunc get_update_direction(SimdLevel level) {
+#if HAVE_X86_KERNELS
+    if (level != SIMD_SCALAR) {
+        return update_direction_avx2;
+    }
+#endif
+    return update_direction_scalar;
+}
+
+ImplicitSolver::ImplicitSolver(int points_x, int points_y, SimdLevel level)
+    : m_points_x(points_x), m_points_y(points_y), m_iteration_index(0), m_time(0), m_level(level),
+      m_pool(nullptr), m_solve(SOLVE_CG), m_relaxation_weight(1.0f),
+      m_solve_tolerance(1e-3f), m_solve_max_iterations(100), m_last_solve_iterations(0),
+      m_solve_iterations(0), m_initial_residual(0), m_last_residual_reduction(0) {
+
+    int total = points_total();
+    m_positions.resize(total);
+    m_velocities.resize(total);
+
+    m_rhs.resize(total * 3);
+    m_dv.resize(total * 3);
+    m_residual.resize(total * 3);
+    m_preconditioned.resize(total * 3);
+    m_direction.resize(total * 3);
+    m_product.resize(total * 3);
+    m_damped_mass.resize(total);
+    m_inv_diagonal.resize(total * 3);
+    m_partials.resize(block_count(total));
+
+    reset();
+}
+
+void ImplicitSolver::reset() {
+    init_cloth_grid(m_points_x, m_points_y, m_positions.data(), m_velocities.data(), nullptr);
+    build_cloth_topology(m_points_x, m_points_y, m_params, m_topology);
+    build_cloth_pins(m_points_x, m_points_y, m_params, m_pins);
+    // Pinned nodes' springs are never linearized, so stay at zero
+    m_jacobians.assign(m_topology.springs(), SpringJacobian());
+
+    sort_by_color(m_topology, m_color_nodes, m_color_offsets);
+    drop_pinned(m_pins, m_color_nodes, m_color_offsets);
+    build_levels();
+
+    // The solve never touches a pinned node's rows, which are all zero:
+    // its dv never changes from 0.
+    memset(m_dv.data(), 0, m_dv.size() * sizeof(float));
+    for (const Pin& pin : m_pins.pins) {
+        for (int i = pin.node * 3; i < pin.node * 3 + 3; i++) {
+            m_rhs[i] = m_product[i] = m_inv_diagonal[i] = 0.0f;
+        }
+    }
+    m_iteration_index = 0;
+    m_time = 0;
+    m_last_solve_iterations = 0;
+    m_solve_iterations = 0;
+    m_last_residual_reduction = 0;
+}
+
+void ImplicitSolver::set_solve_limits(float tolerance, int max_iterations) {
+    m_solve_tolerance = tolerance;
+    m_solve_max_iterations = max_iterations;
+}
+
+void ImplicitSolver::set_solve(ImplicitSolve solve, float weight) {
+    m_solve = solve;
+    m_relaxation_weight = weight;
+}
+
+// Builds every spring's Jacobian block, A's diagonal and the right hand
+// side t (f - t J v) from the current state.
+void ImplicitSolver::linearize() {
+    const float t = m_params.t;
+    const float c = m_params.c;
+    const Vec3f gravity(0.0f, GRAVITY_Y, 0.0f);
+
+    // Pinned nodes only need their mass, which multigrid lumps into the
+    // coarse grids
+    for (const Pin& pin : m_pins.pins) {
+        m_damped_mass[pin.node] = m_positions[pin.node].w + t * c;
+    }
+
+    run_blocks(m_pool, points_total(), [&](int, int block_begin, int block_end) {
+        m_pins.for_free_spans(block_begin, block_end, [&](int begin, int end) {
+            for (int n = begin; n < end; n++) {
+                const Vec4f& p = m_positions[n];
+                const Vec3f& v = m_velocities[n];
+                float* rhs = &m_rhs[n * 3];
+                float* inv_diagonal = &m_inv_diagonal[n * 3];
+                m_damped_mass[n] = p.w + t * c;
+
+                Vec3f F = gravity * p.w - v * c;
+                Vec3f diagonal(m_damped_mass[n], m_damped_mass[n], m_damped_mass[n]);
+                Vec3f Jv(0, 0, 0);
+
+                for (int s = m_topology.offsets[n]; s < m_topology.offsets[n + 1]; s++) {
+                    int other = m_topology.neighbours[s];
+                    const Vec4f& q = m_positions[other];
+                    const SpringCoeffs& spring = m_topology.coeffs[s];
+                    Vec3f d(q.x - p.x, q.y - p.y, q.z - p.z);
+                    float x = d.length();
+                    d = d / x;
+                    F += d * (-spring.stiffness * (spring.rest_length - x));
+
+                    float k = spring.stiffness;
+                    float k_across = k * std::max(1.0f - spring.rest_length / x, 0.0f);
+                    float k_along = k - k_across;
+
+                    SpringJacobian J;
+                    J.xx = k_along * d.x * d.x + k_across;
+                    J.yy = k_along * d.y * d.y + k_across;
+                    J.zz = k_along * d.z * d.z + k_across;
+                    J.xy = k_along * d.x * d.y;
+                    J.xz = k_along * d.x * d.z;
+                    J.yz = k_along * d.y * d.z;
+
+                    Vec3f dv = v - m_velocities[other];
+                    Jv += Vec3f(J.xx * dv.x + J.xy * dv.y + J.xz * dv.z,
+                                J.xy * dv.x + J.yy * dv.y + J.yz * dv.z,
+                                J.xz * dv.x + J.yz * dv.y + J.zz * dv.z);
+
+                    // The solve only ever needs t^2 J
+                    SpringJacobian& scaled = m_jacobians[s];
+                    scaled.xx = J.xx * t * t;
+                    scaled.yy = J.yy * t * t;
+                    scaled.zz = J.zz * t * t;
+                    scaled.xy = J.xy * t * t;
+                    scaled.xz = J.xz * t * t;
+                    scaled.yz = J.yz * t * t;
+                    diagonal += Vec3f(scaled.xx, scaled.yy, scaled.zz);
+                }
+
+                Vec3f b = (F - Jv * t) * t;
+                rhs[0] = b.x;
+                rhs[1] = b.y;
+                rhs[2] = b.z;
+                inv_diagonal[0] = 1.0f / diagonal.x;
+                inv_diagonal[1] = 1.0f / diagonal.y;
+                inv_diagonal[2] = 1.0f / diagonal.z;
+            }
+        });
+    });
+}
+
+double ImplicitSolver::multiply(int block_begin, int block_end) {
+    const float* p = m_direction.data();
+    float* q = m_product.data();
+    double pq = 0;
+
+    m_pins.for_free_spans(block_begin, block_end, [&](int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            const float* pn = p + n * 3;
+            float qx = m_damped_mass[n] * pn[0];
+            float qy = m_damped_mass[n] * pn[1];
+            float qz = m_damped_mass[n] * pn[2];
+
+            for (int s = m_topology.offsets[n]; s < m_topology.offsets[n + 1]; s++) {
+                const float* po = p + m_topology.neighbours[s] * 3;
+                const SpringJacobian& J = m_jacobians[s];
+                float dx = pn[0] - po[0];
+                float dy = pn[1] - po[1];
+                float dz = pn[2] - po[2];
+                qx += J.xx * dx + J.xy * dy + J.xz * dz;
+                qy += J.xy * dx + J.yy * dy + J.yz * dz;
+                qz += J.xz * dx + J.yz * dy + J.zz * dz;
+            }
+
+            q[n * 3] = qx;
+            q[n * 3 + 1] = qy;
+            q[n * 3 + 2] = qz;
+            pq += pn[0] * qx + pn[1] * qy + pn[2] * qz;
+        }
+    });
+    return pq;
+}
+
+double ImplicitSolver::residual_norm() {
+    const float* dv = m_dv.data();
+    float* p = m_direction.data();
+    const float* q = m_product.data();
+    const float* b = m_rhs.data();
+    const float* inv_diagonal = m_inv_diagonal.data();
+    int nodes = points_total();
+
+    run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+        memcpy(p + begin * 3, dv + begin * 3, (end - begin) * 3 * sizeof(float));
+    });
+    run_blocks(m_pool, nodes, [&](int block, int begin, int end) {
+        multiply(begin, end);
+        double rz = 0;
+        for (int i = begin * 3; i < end * 3; i++) {
+            float r = b[i] - q[i];
+            rz += r * inv_diagonal[i] * r;
+        }
+        m_partials[block] = rz;
+    });
+
+    return sum_partials(m_partials);
+}
+
+void ImplicitSolver::solve_cg() {
+    UpdateSolutionFunc update_solution = get_update_solution(m_level);
+    UpdateDirectionFunc update_direction = get_update_direction(m_level);
+    float* dv = m_dv.data();
+    float* r = m_residual.data();
+    float* z = m_preconditioned.data();
+    float* p = m_direction.data();
+    const float* q = m_product.data();
+    const float* b = m_rhs.data();
+    const float* inv_diagonal = m_inv_diagonal.data();
+    int nodes = points_total();
+
+    // Start from the last step's dv: r = b - A dv, z = M^-1 r, p = z.
+    run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+        memcpy(p + begin * 3, dv + begin * 3, (end - begin) * 3 * sizeof(float));
+    });
+    run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+        multiply(begin, end);
+    });
+    run_blocks(m_pool, nodes, [&](int block, int begin, int end) {
+        double rz = 0;
+        for (int i = begin * 3; i < end * 3; i++) {
+            r[i] = b[i] - q[i];
+            z[i] = inv_diagonal[i] * r[i];
+            p[i] = z[i];
+            rz += r[i] * z[i];
+        }
+        m_partials[block] = rz;
+    });
+
+    double rz = sum_partials(m_partials);
+    double target = rz * m_solve_tolerance * m_solve_tolerance;
+    int iteration = 0;
+    m_initial_residual = rz;
+
+    for (; iteration < m_solve_max_iterations && rz > target && rz > 0; iteration++) {
+        run_blocks(m_pool, nodes, [&](int block, int begin, int end) {
+            m_partials[block] = multiply(begin, end);
+        });
+        double pq = sum_partials(m_partials);
+        if (!(pq > 0)) {
+            break;
+        }
+
+        float alpha = (float)(rz / pq);
+        run_blocks(m_pool, nodes, [&](int block, int begin, int end) {
+            m_partials[block] = update_solution(dv, r, z, p, q, inv_diagonal, alpha, begin * 3, end * 3);
+        });
+        double rz_next = sum_partials(m_partials);
+
+        float beta = (float)(rz_next / rz);
+        rz = rz_next;
+        run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+            update_direction(p, z, beta, begin * 3, end * 3);
+        });
+    }
+
+    m_last_solve_iterations = iteration;
+    m_last_residual_reduction = m_initial_residual > 0 ? sqrt(rz / m_initial_residual) : 0.0;
+}
+
+// dv += w M^-1 (b - A dv), every node from the previous sweep's dv. Each
+// sweep's residual is that of the dv it started from.
+void ImplicitSolver::solve_jacobi() {
+    const float w = m_relaxation_weight;
+    float* dv = m_dv.data();
+    float* p = m_direction.data();
+    const float* q = m_product.data();
+    const float* b = m_rhs.data();
+    const float* inv_diagonal = m_inv_diagonal.data();
+    int nodes = points_total();
+
+    double rz = residual_norm();
+    double target = rz * m_solve_tolerance * m_solve_tolerance;
+    int iteration = 0;
+    m_initial_residual = rz;
+
+    for (; iteration < m_solve_max_iterations && rz > target && rz > 0; iteration++) {
+        run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+            memcpy(p + begin * 3, dv + begin * 3, (end - begin) * 3 * sizeof(float));
+        });
+        run_blocks(m_pool, nodes, [&](int block, int begin, int end) {
+            multiply(begin, end);
+            double block_rz = 0;
+            for (int i = begin * 3; i < end * 3; i++) {
+                float r = b[i] - q[i];
+                float z = inv_diagonal[i] * r;
+                dv[i] = p[i] + w * z;
+                block_rz += r * z;
+            }
+            m_partials[block] = block_rz;
+        });
+        rz = sum_partials(m_partials);
+    }
+
+    m_last_solve_iterations = iteration;
+    m_last_residual_reduction = m_initial_residual > 0 ? sqrt(residual_norm() / m_initial_residual) : 0.0;
+}
+
+void ImplicitSolver::solve_gauss_seidel() {
+    double rz = residual_norm();
+    double target = rz * m_solve_tolerance * m_solve_tolerance;
+    int iteration = 0;
+    m_initial_residual = rz;
+
+    SpringSystem fine = system(0);
+    for (; iteration < m_solve_max_iterations && rz > target && rz > 0; iteration++) {
+        rz = relax_colors(m_pool, fine, m_relaxation_weight, false, m_partials);
+    }
+
+    m_last_solve_iterations = iteration;
+    m_last_residual_reduction = m_initial_residual > 0 ? sqrt(residual_norm() / m_initial_residual) : 0.0;
+}
+
+// Gauss-Seidel sweeps before and after each coarse correction, and on
+// the coarsest grid, which is small enough to relax to convergence.
+static const int smoothing_sweeps = 2;
+static const int coarsest_sweeps = 50;
+// Coarsening stops once a level is down to this many nodes.
+static const int coarsest_nodes = 16;
+
+SpringSystem ImplicitSolver::system(int level) {
+    SpringSystem system;
+    if (level == 0) {
+        system.points_x = m_points_x;
+        system.points_y = m_points_y;
+        system.topology = &m_topology;
+        system.jacobians = m_jacobians.data();
+        system.damped_mass = m_damped_mass.data();
+        system.inv_diagonal = m_inv_diagonal.data();
+        system.color_nodes = m_color_nodes.data();
+        system.color_offsets = m_color_offsets.data();
+        system.color_count = color_count();
+        system.dv = m_dv.data();
+        system.rhs = m_rhs.data();
+        system.residual = m_residual.data();
+        return system;
+    }
+
+    MultigridLevel& coarse = m_levels[level - 1];
+    system.points_x = coarse.points_x;
+    system.points_y = coarse.points_y;
+    system.topology = &coarse.topology;
+    system.jacobians = coarse.jacobians.data();
+    system.damped_mass = coarse.damped_mass.data();
+    system.inv_diagonal = coarse.inv_diagonal.data();
+    system.color_nodes = coarse.color_nodes.data();
+    system.color_offsets = coarse.color_offsets.data();
+    system.color_count = (int)coarse.color_offsets.size() - 1;
+    system.dv = coarse.dv.data();
+    system.rhs = coarse.rhs.data();
+    system.residual = coarse.residual.data();
+    return system;
+}
+
+void ImplicitSolver::build_levels() {
+    m_levels.clear();
+
+    int points_x = m_points_x;
+    int points_y = m_points_y;
+
+    while (points_x * points_y > coarsest_nodes && (points_x > 2 || points_y > 2)) {
+        m_levels.push_back(MultigridLevel());
+        MultigridLevel& level = m_levels.back();
+        const SpringTopology& fine_topology =
+            m_levels.size() == 1 ? m_topology : m_levels[m_levels.size() - 2].topology;
+        level.points_x = coarse_count(points_x);
+        level.points_y = coarse_count(points_y);
+        int nodes = level.points_x * level.points_y;
+
+        level.topology.clear();
+        level.fine_springs.clear();
+        for (int j = 0; j < level.points_y; j++) {
+            for (int i = 0; i < level.points_x; i++) {
+                const int neighbours[4][2] = { { i - 1, j }, { i, j - 1 }, { i + 1, j }, { i, j + 1 } };
+                for (const auto& neighbour : neighbours) {
+                    int ni = neighbour[0];
+                    int nj = neighbour[1];
+                    if (ni < 0 || ni >= level.points_x || nj < 0 || nj >= level.points_y) {
+                        continue;
+                    }
+                    level.topology.add_spring(ni + nj * level.points_x, 0.0f, 0.0f);
+
+                    // The fine springs along the way, looked up either way round
+                    int from = fine_point(i, points_x, level.points_x) +
+                        fine_point(j, points_y, level.points_y) * points_x;
+                    int to = fine_point(ni, points_x, level.points_x) +
+                        fine_point(nj, points_y, level.points_y) * points_x;
+                    int unit = ni != i ? ni - i : (nj - j) * points_x;
+                    int segments = 0;
+                    for (int a = from; a != to; a += unit, segments++) {
+                        // A pinned node's own springs are never linearized,
+                        // so take the one from the free end
+                        bool pinned = m_levels.size() == 1 && m_pins.is_pinned(a);
+                        int spring = pinned ? -1 : fine_topology.find_spring(a, a + unit);
+                        if (spring < 0) {
+                            spring = fine_topology.find_spring(a + unit, a);
+                        }
+                        level.fine_springs.push_back(spring);
+                    }
+                    for (; segments < 2; segments++) {
+                        level.fine_springs.push_back(-2);
+                    }
+                }
+                level.topology.finish_node();
+            }
+        }
+
+        sort_by_color(level.topology, level.color_nodes, level.color_offsets);
+        level.jacobians.resize(level.topology.springs());
+        level.damped_mass.resize(nodes);
+        level.inv_diagonal.resize(nodes * 3);
+        level.dv.resize(nodes * 3);
+        level.rhs.resize(nodes * 3);
+        level.residual.resize(nodes * 3);
+
+        points_x = level.points_x;
+        points_y = level.points_y;
+    }
+}
+
+void ImplicitSolver::coarsen() {
+    for (int l = 1; l <= coarse_levels(); l++) {
+        SpringSystem fine = system(l - 1);
+        MultigridLevel& level = m_levels[l - 1];
+        int nodes = level.points_x * level.points_y;
+
+        // Each spring is the mean of the fine ones it spans: in 2D a
+        // lattice is as stiff at any spacing.
+        for (int s = 0; s < level.topology.springs(); s++) {
+            SpringJacobian J = { 0, 0, 0, 0, 0, 0 };
+            float segments = level.fine_springs[s * 2 + 1] == -2 ? 1.0f : 2.0f;
+            for (int i = 0; i < 2; i++) {
+                int spring = level.fine_springs[s * 2 + i];
+                if (spring >= 0) {
+                    const SpringJacobian& fine_J = fine.jacobians[spring];
+                    J.xx += fine_J.xx / segments;
+                    J.yy += fine_J.yy / segments;
+                    J.zz += fine_J.zz / segments;
+                    J.xy += fine_J.xy / segments;
+                    J.xz += fine_J.xz / segments;
+                    J.yz += fine_J.yz / segments;
+                }
+            }
+            level.jacobians[s] = J;
+        }
+
+        // Masses lumped through the interpolation weights; a node is fixed
+        // when the fine node under it is.
+        run_blocks(m_pool, nodes, [&](int, int begin, int end) {
+            for (int n = begin; n < end; n++) {
+                int i = n % level.points_x;
+                int j = n / level.points_x;
+                int fi = fine_point(i, fine.points_x, level.points_x);
+                int fj = fine_point(j, fine.points_y, level.points_y);
+
+                float mass = 0.0f;
+                for (int dj = -1; dj <= 1; dj++) {
+                    float wy = interpolation_weight(fj + dj, j, fine.points_y);
+                    for (int di = -1; di <= 1; di++) {
+                        float w = wy * interpolation_weight(fi + di, i, fine.points_x);
+                        if (w != 0.0f) {
+                            mass += w * fine.damped_mass[fi + di + (fj + dj) * fine.points_x];
+                        }
+                    }
+                }
+                level.damped_mass[n] = mass;
+
+                float* inv_diagonal = &level.inv_diagonal[n * 3];
+                if (fine.inv_diagonal[(fi + fj * fine.points_x) * 3] == 0.0f) {
+                    inv_diagonal[0] = inv_diagonal[1] = inv_diagonal[2] = 0.0f;
+                    continue;
+                }
+
+                Vec3f diagonal(mass, mass, mass);
+                for (int s = level.topology.offsets[n]; s < level.topology.offsets[n + 1]; s++) {
+                    const SpringJacobian& J = level.jacobians[s];
+                    diagonal += Vec3f(J.xx, J.yy, J.zz);
+                }
+                inv_diagonal[0] = 1.0f / diagonal.x;
+                inv_diagonal[1] = 1.0f / diagonal.y;
+                inv_diagonal[2] = 1.0f / diagonal.z;
+            }
+        });
+    }
+}
+
+void ImplicitSolver::v_cycle(int level) {
+    SpringSystem fine = system(level);
+
+    if (level == coarse_levels()) {
+        for (int sweep = 0; sweep < coarsest_sweeps; sweep++) {
+            relax_colors(m_pool, fine, 1.0f, sweep % 2 != 0, m_partials);
+        }
+        return;
+    }
+
+    for (int sweep = 0; sweep < smoothing_sweeps; sweep++) {
+        relax_colors(m_pool, fine, 1.0f, false, m_partials);
+    }
+    compute_residual(m_pool, fine);
+
+    // Restrict the residual (the interpolation's transpose) and solve for
+    // the coarse correction from zero
+    SpringSystem coarse = system(level + 1);
+    run_blocks(m_pool, coarse.nodes(), [&](int, int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            int i = n % coarse.points_x;
+            int j = n / coarse.points_x;
+            int fi = fine_point(i, fine.points_x, coarse.points_x);
+            int fj = fine_point(j, fine.points_y, coarse.points_y);
+
+            float b[3] = { 0.0f, 0.0f, 0.0f };
+            for (int dj = -1; dj <= 1; dj++) {
+                float wy = interpolation_weight(fj + dj, j, fine.points_y);
+                for (int di = -1; di <= 1; di++) {
+                    float w = wy * interpolation_weight(fi + di, i, fine.points_x);
+                    if (w != 0.0f) {
+                        const float* r = fine.residual + (fi + di + (fj + dj) * fine.points_x) * 3;
+                        b[0] += w * r[0];
+                        b[1] += w * r[1];
+                        b[2] += w * r[2];
+                    }
+                }
+            }
+            coarse.rhs[n * 3] = b[0];
+            coarse.rhs[n * 3 + 1] = b[1];
+            coarse.rhs[n * 3 + 2] = b[2];
+            coarse.dv[n * 3] = coarse.dv[n * 3 + 1] = coarse.dv[n * 3 + 2] = 0.0f;
+        }
+    });
+
+    v_cycle(level + 1);
+
+    // Interpolate the correction back up, leaving fixed nodes alone
+    run_blocks(m_pool, fine.nodes(), [&](int, int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            if (fine.inv_diagonal[n * 3] == 0.0f) {
+                continue;
+            }
+
+            int xs[2], ys[2];
+            float wxs[2], wys[2];
+            int nx = interpolation_points(n % fine.points_x, fine.points_x, xs, wxs);
+            int ny = interpolation_points(n / fine.points_x, fine.points_y, ys, wys);
+            float* dv = fine.dv + n * 3;
+            for (int y = 0; y < ny; y++) {
+                for (int x = 0; x < nx; x++) {
+                    float w = wxs[x] * wys[y];
+                    const float* correction = coarse.dv + (xs[x] + ys[y] * coarse.points_x) * 3;
+                    dv[0] += w * correction[0];
+                    dv[1] += w * correction[1];
+                    dv[2] += w * correction[2];
+                }
+            }
+        }
+    });
+
+    // Colours in reverse on the way up, keeping the cycle symmetric
+    for (int sweep = 0; sweep < smoothing_sweeps; sweep++) {
+        relax_colors(m_pool, fine, 1.0f, true, m_partials);
+    }
+}
+
+void ImplicitSolver::solve_multigrid() {
+    coarsen();
+
+    double rz = residual_norm();
+    double target = rz * m_solve_tolerance * m_solve_tolerance;
+    int iteration = 0;
+    m_initial_residual = rz;
+
+    for (; iteration < m_solve_max_iterations && rz > target && rz > 0; iteration++) {
+        v_cycle(0);
+        rz = residual_norm();
+    }
+
+    m_last_solve_iterations = iteration;
+    m_last_residual_reduction = m_initial_residual > 0 ? sqrt(rz / m_initial_residual) : 0.0;
+}
+
+void ImplicitSolver::step() {
+    const float t = m_params.t;
+
+    linearize();
+    switch (m_solve) {
+    case SOLVE_CG:
+        solve_cg();
+        break;
+    case SOLVE_JACOBI:
+        solve_jacobi();
+        break;
+    case SOLVE_GAUSS_SEIDEL:
+        solve_gauss_seidel();
+        break;
+    case SOLVE_MULTIGRID:
+        solve_multigrid();
+        break;
+    }
+    m_solve_iterations += m_last_solve_iterations;
+
+    run_blocks(m_pool, points_total(), [&](int, int block_begin, int block_end) {
+        m_pins.for_free_spans(block_begin, block_end, [&](int begin, int end) {
+            for (int n = begin; n < end; n++) {
+                const float* dv = &m_dv[n * 3];
+                Vec3f& v = m_velocities[n];
+                v += Vec3f(dv[0], dv[1], dv[2]);
+
+                // Same displacement limit as the explicit pass
+                Vec3f s = v * t;
+                s.x = std::min(std::max(s.x, -25.0f), 25.0f);
+                s.y = std::min(std::max(s.y, -25.0f), 25.0f);
+                s.z = std::min(std::max(s.z, -25.0f), 25.0f);
+
+                Vec4f& p = m_positions[n];
+                p = Vec4f(p.x + s.x, p.y + s.y, p.z + s.z, p.w);
+            }
+        });
+    });
+
+    m_time += t;
+    if (m_pins.animated) {
+        m_pins.move(m_time, m_positions.data());
+    }
+
+    m_iteration_index++;
+}
+
+void ImplicitSolver::step(int iterations) {
+    for (int i = iterations; i != 0; --i) {
+        step();
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+
+#include <vector>
+
+#include "particle_store.h"
+#include "soa_spring_solver.h"
+#include "spring_mass_solver.h"
+#include "spring_topology.h"
+#include "thread_pool.h"
+#include "vec_stuff.h"
+
+// Spring Jacobian block -df/dx of one spring, a symmetric 3x3 matrix: k
+// along the spring plus k (1 - L / x) across it while stretched (never
+// negative, so the system stays positive definite).
+struct SpringJacobian {
+    float xx, yy, zz;
+    float xy, xz, yz;
+};
+
+// How ImplicitSolver solves each step's linear system.
+enum ImplicitSolve {
+    // Conjugate gradient, Jacobi preconditioned.
+    SOLVE_CG,
+    // Every node relaxed from the previous sweep's values.
+    SOLVE_JACOBI,
+    // Nodes relaxed in place one colour at a time (red-black on the
+    // 4-connected grid), each colour in parallel.
+    SOLVE_GAUSS_SEIDEL,
+    // Multigrid V-cycles over coarser and coarser grids, Gauss-Seidel
+    // smoothed.
+    SOLVE_MULTIGRID
+};
+
+// A coarser grid for the multigrid solve: every other row and column of
+// the level above, always keeping its last ones (where the cloth is
+// pinned), each node joined to its four neighbours by a spring standing
+// for the fine springs between them.
+struct MultigridLevel {
+    int points_x;
+    int points_y;
+    SpringTopology topology;
+    // The (up to) two fine springs each spring spans, -1 for none.
+    std::vector<int> fine_springs;
+    std::vector<SpringJacobian> jacobians;
+    std::vector<int> color_nodes;
+    std::vector<int> color_offsets;
+    std::vector<float> damped_mass;
+    std::vector<float> inv_diagonal;
+    std::vector<float> dv;
+    std::vector<float> rhs;
+    std::vector<float> residual;
+};
+
+struct SpringSystem;
+
+// Backward Euler for the cloth. Each step of params.t linearizes the
+// springs once and solves
+//
+//     ((m + t c) I + t^2 J) dv = t (f - t J v)
+//
+// for the velocity change dv, then moves each node by t (v + dv). J is
+// never assembled: the solve multiplies by it spring by spring from the
+// topology, by conjugate gradient (the default) or by relaxation sweeps.
+// Stable at any t, so a whole frame can be one step. Node numbering and
+// buffer layout are the same as SpringMassSolver's, row-major.
+class ImplicitSolver {
+public:
+    ImplicitSolver(int points_x, int points_y, SimdLevel level = detect_simd_level());
+
+    void reset();
+
+    void step();
+    void step(int iterations);
+
+    // Runs the solve's loops as blocks of nodes on pool, or on the calling
+    // thread when pool is null.
+    void set_thread_pool(ThreadPool* pool) { m_pool = pool; }
+
+    // The solve stops once the preconditioned residual falls below
+    // tolerance times where it started, or after max_iterations (CG
+    // iterations, relaxation sweeps or V-cycles).
+    void set_solve_limits(float tolerance, int max_iterations);
+
+    // weight scales each relaxation update: below 1 damps Jacobi, above 1
+    // over-relaxes Gauss-Seidel (SOR). CG ignores it.
+    void set_solve(ImplicitSolve solve, float weight = 1.0f);
+    ImplicitSolve solve_method() const { return m_solve; }
+    float relaxation_weight() const { return m_relaxation_weight; }
+
+    int points_x() const { return m_points_x; }
+    int points_y() const { return m_points_y; }
+    int points_total() const { return m_points_x * m_points_y; }
+
+    SimdLevel simd_level() const { return m_level; }
+
+    unsigned iteration_index() const { return m_iteration_index; }
+    // Solve iterations in the last step and in all of them.
+    int last_solve_iterations() const { return m_last_solve_iterations; }
+    long long solve_iterations() const { return m_solve_iterations; }
+    // How far the last step's solve cut the preconditioned residual
+    // (final over initial), measured exactly after it finished.
+    double last_residual_reduction() const { return m_last_residual_reduction; }
+    int color_count() const { return (int)m_color_offsets.size() - 1; }
+    // Multigrid levels below the cloth's own grid.
+    int coarse_levels() const { return (int)m_levels.size(); }
+
+    SpringParams& params() { return m_params; }
+    const SpringParams& params() const { return m_params; }
+
+    const Vec4f* positions() const { return m_positions.data(); }
+    const Vec3f* velocities() const { return m_velocities.data(); }
+    const SpringTopology& topology() const { return m_topology; }
+    const PinSet& pins() const { return m_pins; }
+
+private:
+    void linearize();
+    // q = A p over the free nodes of [begin, end); returns their share of
+    // p . q. Pinned nodes' rows of q stay 0.
+    double multiply(int begin, int end);
+    // Preconditioned residual r . M^-1 r of the current dv.
+    double residual_norm();
+    void solve_cg();
+    void solve_jacobi();
+    void solve_gauss_seidel();
+    void solve_multigrid();
+
+    // Level 0 is the cloth, 1.. the coarse grids.
+    SpringSystem system(int level);
+    void build_levels();
+    // Each coarse level's springs, masses and diagonal from the level above.
+    void coarsen();
+    void v_cycle(int level);
+
+    int m_points_x;
+    int m_points_y;
+    unsigned m_iteration_index;
+    double m_time;
+    SimdLevel m_level;
+    SpringParams m_params;
+    ThreadPool* m_pool;
+
+    ImplicitSolve m_solve;
+    float m_relaxation_weight;
+    float m_solve_tolerance;
+    int m_solve_max_iterations;
+    int m_last_solve_iterations;
+    long long m_solve_iterations;
+    double m_initial_residual;
+    double m_last_residual_reduction;
+
+    std::vector<Vec4f> m_positions;
+    std::vector<Vec3f> m_velocities;
+    SpringTopology m_topology;
+    // Only the free spans are linearized and stepped.
+    PinSet m_pins;
+    // Every spring's Jacobian block, times t^2.
+    std::vector<SpringJacobian> m_jacobians;
+    // Free nodes sorted by colour for Gauss-Seidel; colour i is
+    // [m_color_offsets[i], m_color_offsets[i + 1]) of m_color_nodes.
+    std::vector<int> m_color_nodes;
+    std::vector<int> m_color_offsets;
+    std::vector<MultigridLevel> m_levels;
+
+    // Solve vectors, xyz interleaved per node. dv is kept between steps
+    // as the next solve's starting guess.
+    AlignedArray<float> m_rhs;
+    AlignedArray<float> m_dv;
+    AlignedArray<float> m_residual;
+    AlignedArray<float> m_preconditioned;
+    AlignedArray<float> m_direction;
+    AlignedArray<float> m_product;
+    // (m + t c) on the diagonal of A, and A's inverse diagonal, 0 for
+    // pinned nodes so they never move.
+    AlignedArray<float> m_damped_mass;
+    AlignedArray<float> m_inv_diagonal;
+
+    // Per-block partial sums, so reductions add up in the same order
+    // however many threads ran them.
+    std::vector<double> m_partials;
+};
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <vector>
 
 // GLEW
 #define GLEW_STATIC
@@ -9,8 +13,22 @@
 
 #include <unistd.h>
 
+#include "adaptive_stepper.h"
+#include "bench.h"
+#include "checkpoint.h"
+#include "config.h"
+#include "fixed_step_scheduler.h"
 #include "gl_utils.h"
+#include "headless_context.h"
+#include "node_ordering.h"
+#include "pin_set.h"
+#include "position_readback.h"
+#include "profiler.h"
+#include "sim_thread.h"
+#include "spring_mass_solver.h"
+#include "spring_topology.h"
 #include "stb_image.h"
+#include "trajectory_recorder.h"
 
 const GLint WIDTH = 800;
 const GLint HEIGHT = 600;
@@ -20,28 +38,63 @@ enum BUFFER_TYPE_t
     POSITION_A,
     POSITION_B,
     VELOCITY_A,
-    VELOCITY_B,
-    CONNECTION
+    VELOCITY_B
 };
 
-enum
+// The static buffers the update passes read, bound in this order to
+// texture units 1.. for transform feedback and SSBO bindings 4.. for
+// compute.
+enum TOPOLOGY_BUFFER_t
 {
-    POINTS_X            = 50,
-    POINTS_Y            = 50,
-    POINTS_TOTAL        = (POINTS_X * POINTS_Y),
-    CONNECTIONS_TOTAL   = (POINTS_X - 1) * POINTS_Y + (POINTS_Y - 1) * POINTS_X
+    TOPOLOGY_OFFSETS,
+    TOPOLOGY_NEIGHBOURS,
+    TOPOLOGY_COEFFS,
+    TOPOLOGY_INV_MASS,
+    TOPOLOGY_BUFFER_COUNT
 };
 
+AppConfig       config;
+
 GLuint          m_vao[2];
-GLuint          m_vbo[5];
+GLuint          m_vbo[4];
 GLuint          m_index_buffer;
+GLsizei         m_index_count;
 GLuint          m_pos_tbo[2];
+GLuint          m_topology_buffer[TOPOLOGY_BUFFER_COUNT];
+GLuint          m_topology_tbo[TOPOLOGY_BUFFER_COUNT];
 GLuint          m_update_program;
 GLuint          m_render_program;
 GLuint          m_iteration_index;
-
+// Which of the A/B buffers holds the current state. Flips once per
+// update pass, which for the compute backend can be several substeps.
+GLuint          m_buffer_index;
+bool            m_use_compute;
+GLuint          m_compute_program;
+GLuint          m_grid_order_buffer[2];
+int             m_fused_steps;
+SpringParams    m_spring_params;
+SpringTopology  m_topology;
+NodePermutation m_node_permutation;
+PinSet          m_pins;
+// Swaying pins only: the positions the pins are moved in before their
+// spans are uploaded after each update pass.
+std::vector<Vec4f> m_pin_positions;
+
+// Substeps per frame when config.step_rate is 0, and per tick on the
+// simulation thread.
 int             iterations_per_frame = 16;
 
+FrameProfiler*  m_profiler;
+PositionReadback m_readback;
+SimulationThread m_sim_thread;
+std::vector<Vec4f> m_sim_positions;
+
+// Side of the compute backend's square workgroup tiles.
+const int COMPUTE_TILE = 16;
+
+// How often a profiled run prints its rolling percentiles.
+const int PROFILE_SUMMARY_FRAMES = 300;
+
 
 
 
@@ -49,9 +102,13 @@ static void error_callback(int error, const char* description) {
     std::cout << description << std::endl;
 }
 
+static std::string shader_path(const char* name) {
+    return config.shader_dir + "/" + name;
+}
+
 void load_shaders() {
 
-    GLuint vs = load_shader("../../../shaders/springmass/update.vs.glsl", GL_VERTEX_SHADER);
+    GLuint vs = load_shader(shader_path("springmass/update.vs.glsl").c_str(), GL_VERTEX_SHADER);
 
     if (m_update_program)
         glDeleteProgram(m_update_program);
@@ -68,81 +125,217 @@ void load_shaders() {
     glLinkProgram(m_update_program);
 
     m_render_program = make_prog(
-        "../../../shaders/springmass/render.vs.glsl",
-        "../../../shaders/springmass/render.fs.glsl");
+        shader_path("springmass/render.vs.glsl").c_str(),
+        shader_path("springmass/render.fs.glsl").c_str());
     if (m_render_program == 0) {
         std::cout << "Failed to create the shader program" << std::endl;
         exit(-1);
     }
 }
 
+// Furthest any spring reaches across the grid, in rows or columns.
+static int spring_reach() {
+    const int points_x = config.points_x;
+    const std::vector<int>& to_grid = m_node_permutation.to_grid;
+    int reach = 0;
+
+    for (int n = 0; n < m_topology.nodes(); n++) {
+        int a = m_node_permutation.is_identity() ? n : to_grid[n];
+        for (int s = m_topology.offsets[n]; s < m_topology.offsets[n + 1]; s++) {
+            int other = m_topology.neighbours[s];
+            int b = m_node_permutation.is_identity() ? other : to_grid[other];
+            reach = std::max(reach, std::abs(a % points_x - b % points_x));
+            reach = std::max(reach, std::abs(a / points_x - b / points_x));
+        }
+    }
+    return reach;
+}
+
+// Builds the compute program with as many fused substeps as fit in
+// shared memory, up to config.fused_steps.
+void startup_compute() {
+    GLint max_shared;
+    glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &max_shared);
+
+    // Two positions, a velocity (padded to a vec4), an inverse mass and a
+    // node index per slot of the tile plus its halo.
+    const int bytes_per_slot = 3 * sizeof(Vec4f) + sizeof(float) + sizeof(int);
+
+    int reach = std::max(spring_reach(), 1);
+    m_fused_steps = config.fused_steps;
+    while (m_fused_steps > 1) {
+        int region = COMPUTE_TILE + 2 * reach * m_fused_steps;
+        if (region * region * bytes_per_slot <= max_shared) {
+            break;
+        }
+        m_fused_steps--;
+    }
+
+    std::string defines =
+        "#define TILE " + std::to_string(COMPUTE_TILE) + "\n" +
+        "#define REACH " + std::to_string(reach) + "\n" +
+        "#define FUSED_STEPS " + std::to_string(m_fused_steps) + "\n" +
+        "#define HALO " + std::to_string(reach * m_fused_steps) + "\n";
+    if (!m_node_permutation.is_identity()) {
+        defines += "#define PERMUTED\n";
+    }
+
+    m_compute_program = make_compute_prog(shader_path("springmass/update.cs.glsl").c_str(), defines.c_str());
+    if (m_compute_program == 0) {
+        std::cout << "Failed to create the compute program" << std::endl;
+        exit(-1);
+    }
+
+    glUseProgram(m_compute_program);
+    glUniform2i(get_uniform_loc(m_compute_program, "grid_size"), config.points_x, config.points_y);
+    glUniform1f(get_uniform_loc(m_compute_program, "t"), m_spring_params.t);
+    glUniform1f(get_uniform_loc(m_compute_program, "c"), m_spring_params.c);
+    glUniform1i(get_uniform_loc(m_compute_program, "active_end"), m_pins.active_end());
+
+    if (!m_node_permutation.is_identity()) {
+        glGenBuffers(2, m_grid_order_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_grid_order_buffer[0]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_node_permutation.to_grid.size() * sizeof(int),
+            m_node_permutation.to_grid.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_grid_order_buffer[1]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_node_permutation.from_grid.size() * sizeof(int),
+            m_node_permutation.from_grid.data(), GL_STATIC_DRAW);
+    }
+
+    std::cout << "Compute backend: " << COMPUTE_TILE << "x" << COMPUTE_TILE << " tiles, " <<
+        m_fused_steps << " fused substeps, halo " << reach * m_fused_steps << std::endl;
+}
+
 void startup() {
-    int i, j;
+    int i;
+
+    m_spring_params.k_shear = config.shear_k;
+    m_spring_params.k_bend = config.bend_k;
+    m_spring_params.pins = config.pins;
+    m_spring_params.pin_sway = config.pin_sway;
+
+    // A checkpoint brings its own grid size, so open it before anything
+    // gets sized. Its arrays are uploaded straight from the mapping.
+    MappedCheckpoint checkpoint;
+    if (!config.restore.empty()) {
+        if (!checkpoint.open(config.restore.c_str())) {
+            exit(-1);
+        }
+        config.points_x = checkpoint.header().points_x;
+        config.points_y = checkpoint.header().points_y;
+        m_iteration_index = checkpoint.header().iteration_index;
+        m_spring_params = checkpoint.params();
+        config.node_order = (NodeOrder)checkpoint.header().node_order;
+    }
+
+    const int points_x = config.points_x;
+    const int points_y = config.points_y;
+    const int points_total = config.points_total();
+
+    // The pins go last in the node order, so both update passes can stop
+    // at the last free node.
+    build_node_order(points_x, points_y, config.node_order, m_node_permutation);
+    build_cloth_pins(points_x, points_y, m_spring_params, m_pins);
+    order_pins_last(m_pins, points_total, m_node_permutation);
+    permute_pins(m_node_permutation, m_pins);
+    std::cout << m_pins.size() << " " << pin_layout_name(m_spring_params.pins) << " pins";
+    if (m_pins.animated) {
+        std::cout << ", swaying " << m_spring_params.pin_sway;
+    }
+    std::cout << "; update passes stop at node " << m_pins.active_end() << std::endl;
 
     load_shaders();
 
-    Vec4f* initial_positions = new Vec4f[POINTS_TOTAL];
-    Vec3f* initial_velocities = new Vec3f[POINTS_TOTAL];
-    Vec4i* connection_vectors = new Vec4i[POINTS_TOTAL];
+    glUseProgram(m_update_program);
+    glUniform1f(get_uniform_loc(m_update_program, "t"), m_spring_params.t);
+    glUniform1f(get_uniform_loc(m_update_program, "c"), m_spring_params.c);
+    glUniform1i(get_uniform_loc(m_update_program, "tex_offsets"), 1);
+    glUniform1i(get_uniform_loc(m_update_program, "tex_neighbours"), 2);
+    glUniform1i(get_uniform_loc(m_update_program, "tex_springs"), 3);
+    glUniform1i(get_uniform_loc(m_update_program, "tex_inv_mass"), 4);
+
+    if (!config.restore.empty()) {
+        if (!checkpoint.read_topology(m_topology)) {
+            exit(-1);
+        }
+    }
+    else {
+        build_cloth_topology(points_x, points_y, m_spring_params, m_topology);
+        permute_topology(m_node_permutation, m_topology);
+    }
 
-    int n = 0;
+    bool compute_supported = GLEW_VERSION_4_3 ||
+        (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+    m_use_compute = compute_supported && config.backend != BACKEND_FEEDBACK;
+    if (config.backend == BACKEND_COMPUTE && !compute_supported) {
+        std::cout << "No GL 4.3 compute shaders; falling back to transform feedback" << std::endl;
+    }
+    if (m_use_compute) {
+        startup_compute();
+    }
 
-    for (j = 0; j < POINTS_Y; j++) {
-        float fj = (float)j / (float)POINTS_Y;
-        for (i = 0; i < POINTS_X; i++) {
-            float fi = (float)i / (float)POINTS_X;
+    GLint max_texels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if (!m_use_compute && (points_total + 1 > max_texels || m_topology.springs() > max_texels)) {
+        std::cout << "grid has " << points_total << " points and " << m_topology.springs() <<
+            " springs but a TBO can only hold " << max_texels << std::endl;
+        exit(-1);
+    }
 
-            initial_positions[n] = Vec4f((fi - 0.5f) * (float)POINTS_X,
-                                         (fj - 0.5f) * (float)POINTS_Y,
-                                         0.6f * sinf(fi) * cosf(fj),
-                                         1.0f);
-            initial_velocities[n] = Vec3f(0, 0, 0);
+    // Keep the whole cloth on screen whatever its size; 0.03 is the
+    // original scale for the 50x50 grid.
+    glUseProgram(m_render_program);
+    glUniform1f(get_uniform_loc(m_render_program, "scale"),
+        0.03f * 50.0f / (float)std::max(points_x, points_y));
 
-            connection_vectors[n] = Vec4i(-1, -1, -1, -1);
+    std::vector<Vec4f> grid_positions;
+    std::vector<Vec3f> grid_velocities;
 
-            if (j != (POINTS_Y - 1))
-            {
-                if (i != 0)
-                    connection_vectors[n][0] = n - 1;
+    const Vec4f* initial_positions;
+    const Vec3f* initial_velocities;
 
-                if (j != 0)
-                    connection_vectors[n][1] = n - POINTS_X;
+    if (!config.restore.empty()) {
+        initial_positions = checkpoint.positions();
+        initial_velocities = checkpoint.velocities();
+    }
+    else {
+        grid_positions.resize(points_total);
+        grid_velocities.resize(points_total);
 
-                if (i != (POINTS_X - 1))
-                    connection_vectors[n][2] = n + 1;
+        init_cloth_grid(points_x, points_y,
+            grid_positions.data(), grid_velocities.data(), nullptr);
+        permute_nodes(m_node_permutation, grid_positions.data(), grid_velocities.data());
 
-                if (j != (POINTS_Y - 1))
-                    connection_vectors[n][3] = n + POINTS_X;
-            }
-            n++;
-        }
+        initial_positions = grid_positions.data();
+        initial_velocities = grid_velocities.data();
     }
 
     glGenVertexArrays(2, m_vao);
-    glGenBuffers(5, m_vbo);
+    glGenBuffers(4, m_vbo);
 
     for (i = 0; i < 2; i++) {
         glBindVertexArray(m_vao[i]);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_vbo[POSITION_A + i]);
-        glBufferData(GL_ARRAY_BUFFER, POINTS_TOTAL * sizeof(Vec4f), initial_positions, GL_DYNAMIC_COPY);
+        glBufferData(GL_ARRAY_BUFFER, points_total * sizeof(Vec4f), initial_positions, GL_DYNAMIC_COPY);
         glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
         glEnableVertexAttribArray(0);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_vbo[VELOCITY_A + i]);
-        glBufferData(GL_ARRAY_BUFFER, POINTS_TOTAL * sizeof(Vec3f), initial_velocities, GL_DYNAMIC_COPY);
+        glBufferData(GL_ARRAY_BUFFER, points_total * sizeof(Vec3f), initial_velocities, GL_DYNAMIC_COPY);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
         glEnableVertexAttribArray(1);
+    }
+
+    // Computed once here rather than dividing by the mass every substep
+    std::vector<float> inv_masses;
+    compute_inverse_masses(m_pins, initial_positions, points_total, inv_masses);
 
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo[CONNECTION]);
-        glBufferData(GL_ARRAY_BUFFER, POINTS_TOTAL * sizeof(Vec4i), connection_vectors, GL_STATIC_DRAW);
-        glVertexAttribIPointer(2, 4, GL_INT, 0, NULL);
-        glEnableVertexAttribArray(2);
+    if (m_pins.animated) {
+        m_pin_positions.assign(initial_positions, initial_positions + points_total);
     }
 
-    delete [] connection_vectors;
-    delete [] initial_velocities;
-    delete [] initial_positions;
+    checkpoint.close();
 
     glGenTextures(2, m_pos_tbo);
     glBindTexture(GL_TEXTURE_BUFFER, m_pos_tbo[0]);
@@ -150,56 +343,235 @@ void startup() {
     glBindTexture(GL_TEXTURE_BUFFER, m_pos_tbo[1]);
     glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_vbo[POSITION_B]);
 
-    int lines = (POINTS_X - 1) * POINTS_Y + (POINTS_Y - 1) * POINTS_X;
+    glGenBuffers(TOPOLOGY_BUFFER_COUNT, m_topology_buffer);
+    glGenTextures(TOPOLOGY_BUFFER_COUNT, m_topology_tbo);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_topology_buffer[TOPOLOGY_OFFSETS]);
+    glBufferData(GL_TEXTURE_BUFFER, m_topology.offsets.size() * sizeof(int),
+        m_topology.offsets.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_topology_tbo[TOPOLOGY_OFFSETS]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, m_topology_buffer[TOPOLOGY_OFFSETS]);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_topology_buffer[TOPOLOGY_NEIGHBOURS]);
+    glBufferData(GL_TEXTURE_BUFFER, m_topology.neighbours.size() * sizeof(int),
+        m_topology.neighbours.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_topology_tbo[TOPOLOGY_NEIGHBOURS]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, m_topology_buffer[TOPOLOGY_NEIGHBOURS]);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_topology_buffer[TOPOLOGY_COEFFS]);
+    glBufferData(GL_TEXTURE_BUFFER, m_topology.coeffs.size() * sizeof(SpringCoeffs),
+        m_topology.coeffs.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_topology_tbo[TOPOLOGY_COEFFS]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, m_topology_buffer[TOPOLOGY_COEFFS]);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_topology_buffer[TOPOLOGY_INV_MASS]);
+    glBufferData(GL_TEXTURE_BUFFER, inv_masses.size() * sizeof(float),
+        inv_masses.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_topology_tbo[TOPOLOGY_INV_MASS]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, m_topology_buffer[TOPOLOGY_INV_MASS]);
+
+    std::vector<int> lines;
+    m_topology.line_indices(lines);
+    m_index_count = (GLsizei)lines.size();
 
     glGenBuffers(1, &m_index_buffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lines * 2 * sizeof(int), NULL, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lines.size() * sizeof(int), lines.data(), GL_STATIC_DRAW);
+}
 
-    int * e = (int *)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, lines * 2 * sizeof(int), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+// Reads the current state back from the GL buffers and writes it out.
+// This stalls until the GPU has finished the last substep.
+bool save_checkpoint(const char* path) {
+    const int points_total = config.points_total();
+    const unsigned current = m_buffer_index & 1;
+
+    // Both buffers are only read, so both are mapped through
+    // GL_COPY_READ_BUFFER, rebinding it to unmap each.
+    GLuint position_vbo = m_vbo[POSITION_A + current];
+    GLuint velocity_vbo = m_vbo[VELOCITY_A + current];
+
+    glBindBuffer(GL_COPY_READ_BUFFER, position_vbo);
+    const Vec4f* positions = (const Vec4f*)glMapBufferRange(
+        GL_COPY_READ_BUFFER, 0, points_total * sizeof(Vec4f), GL_MAP_READ_BIT);
+    if (!positions) {
+        std::cout << "couldn't map the position buffer for checkpoint " << path << std::endl;
+        return false;
+    }
 
-    for (j = 0; j < POINTS_Y; j++)
-    {
-        for (i = 0; i < POINTS_X - 1; i++)
-        {
-            *e++ = i + j * POINTS_X;
-            *e++ = 1 + i + j * POINTS_X;
+    glBindBuffer(GL_COPY_READ_BUFFER, velocity_vbo);
+    const Vec3f* velocities = (const Vec3f*)glMapBufferRange(
+        GL_COPY_READ_BUFFER, 0, points_total * sizeof(Vec3f), GL_MAP_READ_BIT);
+
+    bool ok = false;
+    if (!velocities) {
+        std::cout << "couldn't map the velocity buffer for checkpoint " << path << std::endl;
+    }
+    else {
+        ok = write_checkpoint(path, config.points_x, config.points_y, m_iteration_index,
+            config.node_order, m_spring_params, positions, velocities, m_topology);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, position_vbo);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+    return ok;
+}
+
+// Hands positions captured at frame to the recorder, dropping the frame
+// when the recorder's queue is full.
+void record_positions(TrajectoryRecorder& recorder, const Vec4f* positions, uint64_t frame) {
+    Vec4f* dst = recorder.begin_frame((uint32_t)frame);
+    if (dst) {
+        std::copy(positions, positions + config.points_total(), dst);
+        recorder.end_frame();
+    }
+}
+
+// Queues this frame's positions for readback and passes the newest copy
+// that has arrived to the consumers. Without persistent mapping the
+// recorder falls back to a blocking read of the current frame.
+void read_back_positions(TrajectoryRecorder& recorder, uint64_t frame) {
+    ProfilePhase phase(m_profiler, "readback");
+    GLuint current = m_vbo[POSITION_A + (m_buffer_index & 1)];
+
+    if (m_readback.is_created()) {
+        m_readback.capture(current, frame);
+        uint64_t captured;
+        const Vec4f* positions = m_readback.acquire_latest_positions(&captured);
+        if (positions && recorder.is_open()) {
+            record_positions(recorder, positions, captured);
+        }
+    }
+    else if (recorder.is_open()) {
+        Vec4f* dst = recorder.begin_frame((uint32_t)frame);
+        if (dst) {
+            glBindBuffer(GL_COPY_READ_BUFFER, current);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, config.points_total() * sizeof(Vec4f), dst);
+            recorder.end_frame();
         }
     }
+}
 
-    for (i = 0; i < POINTS_X; i++)
-    {
-        for (j = 0; j < POINTS_Y - 1; j++)
-        {
-            *e++ = i + j * POINTS_X;
-            *e++ = POINTS_X + i + j * POINTS_X;
+// Swaying pins: moves them to their targets at the current iteration and
+// writes their spans into the current position buffer, which the next
+// pass reads.
+static void upload_pins() {
+    m_pins.move(m_iteration_index * (double)m_spring_params.t, m_pin_positions.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo[POSITION_A + (m_buffer_index & 1)]);
+    for (const NodeSpan& span : m_pins.pinned_spans) {
+        glBufferSubData(GL_ARRAY_BUFFER, span.begin * sizeof(Vec4f),
+            (span.end - span.begin) * sizeof(Vec4f), m_pin_positions.data() + span.begin);
+    }
+}
+
+// Runs substeps with the compute program, up to m_fused_steps per
+// dispatch.
+void update_compute(int substeps) {
+    int i;
+    glUseProgram(m_compute_program);
+
+    for (i = 0; i < TOPOLOGY_BUFFER_COUNT; i++) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4 + i, m_topology_buffer[i]);
+    }
+    if (!m_node_permutation.is_identity()) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_grid_order_buffer[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_grid_order_buffer[1]);
+    }
+
+    GLint steps_loc = get_uniform_loc(m_compute_program, "steps");
+    GLuint groups_x = (config.points_x + COMPUTE_TILE - 1) / COMPUTE_TILE;
+    GLuint groups_y = (config.points_y + COMPUTE_TILE - 1) / COMPUTE_TILE;
+
+    for (int remaining = substeps; remaining > 0; ) {
+        ProfilePhase phase(m_profiler, "update dispatch");
+        int steps = std::min(remaining, m_fused_steps);
+        glUniform1i(steps_loc, steps);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_vbo[POSITION_A + (m_buffer_index & 1)]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_vbo[VELOCITY_A + (m_buffer_index & 1)]);
+        m_buffer_index++;
+        m_iteration_index += steps;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_vbo[POSITION_A + (m_buffer_index & 1)]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_vbo[VELOCITY_A + (m_buffer_index & 1)]);
+
+        glDispatchCompute(groups_x, groups_y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        if (m_pins.animated) {
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            upload_pins();
         }
+        remaining -= steps;
     }
 
-    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    // The results are drawn as vertex attributes and read back by the
+    // recorder and checkpoints.
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindVertexArray(m_vao[m_buffer_index & 1]);
 }
 
-// void render(double t)
-void render(GLFWwindow* window)
-{
+// Runs substeps as transform-feedback passes. Each pass stops at the
+// last free node; the pins, all numbered after it, keep whatever the
+// destination buffer already holds.
+void update_feedback(int substeps) {
     int i;
     glUseProgram(m_update_program);
 
     glEnable(GL_RASTERIZER_DISCARD);
 
-    for (i = iterations_per_frame; i != 0; --i)
+    for (i = 0; i < TOPOLOGY_BUFFER_COUNT; i++) {
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, m_topology_tbo[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    for (i = substeps; i != 0; --i)
     {
-        glBindVertexArray(m_vao[m_iteration_index & 1]);
-        glBindTexture(GL_TEXTURE_BUFFER, m_pos_tbo[m_iteration_index & 1]);
+        ProfilePhase phase(m_profiler, "update substep");
+        glBindVertexArray(m_vao[m_buffer_index & 1]);
+        glBindTexture(GL_TEXTURE_BUFFER, m_pos_tbo[m_buffer_index & 1]);
+        m_buffer_index++;
         m_iteration_index++;
-        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_vbo[POSITION_A + (m_iteration_index & 1)]);
-        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, m_vbo[VELOCITY_A + (m_iteration_index & 1)]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_vbo[POSITION_A + (m_buffer_index & 1)]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, m_vbo[VELOCITY_A + (m_buffer_index & 1)]);
         glBeginTransformFeedback(GL_POINTS);
-        glDrawArrays(GL_POINTS, 0, POINTS_TOTAL);
+        glDrawArrays(GL_POINTS, 0, m_pins.active_end());
         glEndTransformFeedback();
+        if (m_pins.animated) {
+            upload_pins();
+        }
     }
 
     glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Uploads the simulation thread's state, interpolated to now, as the
+// current positions.
+void upload_sim_state() {
+    ProfilePhase phase(m_profiler, "sim upload");
+    m_sim_thread.interpolate(m_sim_positions.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo[POSITION_A + (m_buffer_index & 1)]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_sim_positions.size() * sizeof(Vec4f), m_sim_positions.data());
+    glBindVertexArray(m_vao[m_buffer_index & 1]);
+}
+
+// void render(double t)
+void render(GLFWwindow* window, int substeps)
+{
+    if (config.sim_thread) {
+        upload_sim_state();
+    }
+    else if (substeps == 0) {
+        // Nothing due yet; draw the current state again
+    }
+    else if (m_use_compute) {
+        update_compute(substeps);
+    }
+    else {
+        update_feedback(substeps);
+    }
 
     static const GLfloat black[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 
@@ -210,47 +582,71 @@ void render(GLFWwindow* window)
 
     // if (draw_points)
     // {
+    {
+        ProfilePhase phase(m_profiler, "draw points");
         glPointSize(4.0f);
-        glDrawArrays(GL_POINTS, 0, POINTS_TOTAL);
+        glDrawArrays(GL_POINTS, 0, config.points_total());
+    }
     // }
 
     // if (draw_lines)
     // {
+        ProfilePhase phase(m_profiler, "draw lines");
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
-        glDrawElements(GL_LINES, CONNECTIONS_TOTAL * 2, GL_UNSIGNED_INT, NULL);
+        glDrawElements(GL_LINES, m_index_count, GL_UNSIGNED_INT, NULL);
     // }
 }
 
 int main(int argc, const char* argv[]) {
+    if (!parse_args(argc, argv, config)) {
+        return -1;
+    }
+
+    if (config.bench) {
+        return run_benchmarks(config);
+    }
+
     char buf[256];
     getcwd(buf, sizeof(buf));
     std::cout << "cwd: " << buf << std::endl;
 
-    glfwInit();
+    HeadlessContext headless;
+    GLFWwindow* window = nullptr;
+    int screen_width, screen_height;
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+    if (config.headless) {
+        if (!headless.create(4, 0)) {
+            return -1;
+        }
+        screen_width = WIDTH;
+        screen_height = HEIGHT;
+    }
+    else {
+        glfwInit();
 
-    glfwSetErrorCallback(error_callback);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 
-    GLFWwindow* window = glfwCreateWindow(
-        WIDTH, HEIGHT, "OpenGL Play 01", nullptr, nullptr);
+        glfwSetErrorCallback(error_callback);
 
-    if (!window) {
-        glGetError();
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+        window = glfwCreateWindow(
+            WIDTH, HEIGHT, "OpenGL Play 01", nullptr, nullptr);
 
-        return -1;
-    }
+        if (!window) {
+            glGetError();
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
 
-    int screen_width, screen_height;
-    glfwGetFramebufferSize(window, &screen_width, &screen_height);
+            return -1;
+        }
+
+        glfwGetFramebufferSize(window, &screen_width, &screen_height);
 
-    glfwMakeContextCurrent(window);
+        glfwMakeContextCurrent(window);
+    }
 
     glewExperimental = GL_TRUE;
 
@@ -259,20 +655,172 @@ int main(int argc, const char* argv[]) {
         return -1;
     }
 
+    if (config.headless && !headless.create_framebuffer(screen_width, screen_height)) {
+        return -1;
+    }
+
     startup();
 
 
     glViewport(0, 0, screen_width, screen_height);
 
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+    if (!config.profile.empty()) {
+        m_profiler = new FrameProfiler();
+        if (!m_profiler->gpu_timers()) {
+            std::cout << "No GL timer queries; profiling CPU time only" << std::endl;
+        }
+    }
+
+    TrajectoryRecorder recorder;
+    recorder.set_node_order(m_node_permutation);
+    if (!config.record.empty() &&
+        !recorder.open(config.record.c_str(), config.points_total(),
+            config.record_error, config.record_keyframes)) {
+        return -1;
+    }
+
+    if ((config.readback || recorder.is_open()) && !m_readback.create(config.points_total())) {
+        std::cout << "No persistent buffer mapping; reading positions back synchronously" << std::endl;
+    }
+
+    if (config.sim_thread) {
+        m_sim_positions.resize(config.points_total());
+        AdaptiveStepLimits limits;
+        limits.max_substeps = config.max_substeps;
+        m_sim_thread.start(config.points_x, config.points_y, m_spring_params,
+            m_node_permutation, config.tick_rate, iterations_per_frame,
+            config.adaptive ? &limits : nullptr, config.integrator,
+            config.solve, config.relax_weight);
+    }
+
+    int max_frames = config.frames;
+    if (config.headless && max_frames == 0) {
+        max_frames = DEFAULT_HEADLESS_FRAMES;
+    }
+
+    // Each step advances the cloth by the shader's t, which was tuned for
+    // iterations_per_frame steps a frame at 60 fps; step_rate keeps that
+    // speed in real time whatever the frame rate.
+    FixedStepScheduler* scheduler = nullptr;
+    if (config.step_rate > 0 && !config.sim_thread) {
+        scheduler = new FixedStepScheduler(1.0 / config.step_rate, config.max_catchup_steps);
+    }
+
+    int frame = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last_frame = start;
 
-        render(window);
+    while (config.headless || !glfwWindowShouldClose(window)) {
+        if (window) {
+            glfwPollEvents();
+        }
+
+        if (m_profiler) {
+            m_profiler->begin_frame();
+        }
+
+        int substeps = iterations_per_frame;
+        if (scheduler) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            substeps = scheduler->advance(std::chrono::duration<double>(now - last_frame).count());
+            last_frame = now;
+        }
+
+        render(window, substeps);
+
+        if (recorder.is_open() || m_readback.is_created()) {
+            read_back_positions(recorder, frame);
+        }
+
+        {
+            ProfilePhase phase(m_profiler, "swap");
+            if (window) {
+                glfwSwapBuffers(window);
+            }
+            else {
+                headless.swap_buffers();
+            }
+        }
+
+        if (m_profiler) {
+            m_profiler->end_frame();
+            if (m_profiler->frame_count() % PROFILE_SUMMARY_FRAMES == 0) {
+                m_profiler->print_summary(std::cout);
+            }
+        }
+
+        ++frame;
+
+        // A failed periodic checkpoint leaves the previous one in place;
+        // say so and keep running.
+        if (config.checkpoint_interval && frame % config.checkpoint_interval == 0 &&
+            !save_checkpoint(config.checkpoint.c_str())) {
+            std::cout << "checkpoint at frame " << frame << " failed" << std::endl;
+        }
+
+        if (frame == max_frames) {
+            break;
+        }
+    }
+
+    glFinish();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << frame << " frames in " << elapsed << " s (" << frame / elapsed << " fps)" << std::endl;
+
+    if (scheduler) {
+        std::cout << "scheduler: ";
+        scheduler->print_stats(std::cout, elapsed);
+        delete scheduler;
+        scheduler = nullptr;
+    }
+
+    if (config.sim_thread) {
+        double sim_elapsed = m_sim_thread.elapsed_seconds();
+        m_sim_thread.stop();
+        std::cout << "sim thread: " << m_sim_thread.ticks() << " ticks in " << sim_elapsed << " s (" <<
+            m_sim_thread.ticks() / sim_elapsed << " ticks/s, " << m_sim_thread.late_ticks() << " late)" << std::endl;
+        if (m_sim_thread.implicit_solver()) {
+            std::cout << "implicit: " << m_sim_thread.implicit_solver()->solve_iterations() /
+                (double)m_sim_thread.ticks() << " solve iterations per tick" << std::endl;
+        }
+        if (m_sim_thread.adaptive()) {
+            std::cout << "adaptive: ";
+            m_sim_thread.stepper().print_stats(std::cout, iterations_per_frame);
+        }
+    }
+
+    if (m_profiler) {
+        m_profiler->print_summary(std::cout);
+        m_profiler->write_chrome_trace(config.profile.c_str());
+        delete m_profiler;
+        m_profiler = nullptr;
+    }
+
+    if (m_readback.is_created()) {
+        m_readback.print_latency(std::cout);
+        m_readback.destroy();
+    }
+
+    if (recorder.is_open()) {
+        recorder.close();
+        std::cout << "recorded " << recorder.frames_written() << " frames (" <<
+            recorder.frames_dropped() << " dropped), " <<
+            recorder.bytes_written() / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
 
-        glfwSwapBuffers(window);
+    if (!config.checkpoint.empty() && !save_checkpoint(config.checkpoint.c_str())) {
+        return -1;
     }
 
-    glfwTerminate();
+    if (config.headless) {
+        if (!config.dump_frame.empty() && !headless.save_frame(config.dump_frame.c_str())) {
+            return -1;
+        }
+        headless.destroy();
+    }
+    else {
+        glfwTerminate();
+    }
 
     return 0;
 }
@@ -0,0 +1,186 @@
+#include "matrix_math.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+void get_identity_matrix(Matrix44f& result) {
+    memset(result, 0, sizeof(result));
+    for (int i = 0; i < 4; i++) {
+        result[i][i] = 1;
+    }
+}
+
+// Each row of the result is a sum of m2's rows weighted by that row of
+// m1, added up in the same order as the scalar loop so both round alike.
+// All of m2 and each row of m1 are loaded before anything is stored.
+void mult_matrices(
+    const Matrix44f& m1, const Matrix44f& m2,
+    Matrix44f& result) {
+
+#if HAVE_X86_KERNELS
+    const __m128 b0 = _mm_loadu_ps(m2[0]);
+    const __m128 b1 = _mm_loadu_ps(m2[1]);
+    const __m128 b2 = _mm_loadu_ps(m2[2]);
+    const __m128 b3 = _mm_loadu_ps(m2[3]);
+
+    for (int x = 0; x < 4; x++) {
+        __m128 a = _mm_loadu_ps(m1[x]);
+        __m128 row = _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x55), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xaa), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xff), b3));
+        _mm_storeu_ps(result[x], row);
+    }
+#else
+    Matrix44f tmp_result = {0};
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            for (int i = 0; i < 4; i++) {
+                tmp_result[x][y] += m1[x][i] * m2[i][y];
+            }
+        }
+    }
+
+    memcpy(result, tmp_result, sizeof(result));
+#endif
+}
+
+void add_y_rotation_to_matrix(Matrix44f& m, float rot) {
+    float s = sin(rot);
+    float c = cos(rot);
+
+    for (int x = 0; x < 4; x++) {
+        float m0 = m[x][0];
+        float m2 = m[x][2];
+        m[x][0] = m0 * c + m2 * s;
+        m[x][2] = m0 * -s + m2 * c;
+    }
+}
+
+void add_translation_to_matrix(Matrix44f& m, const Vec3f& offset) {
+    for (int x = 0; x < 4; x++) {
+        float w = m[x][3];
+        m[x][0] += w * offset.x;
+        m[x][1] += w * offset.y;
+        m[x][2] += w * offset.z;
+    }
+}
+
+typedef void (*TransformKernel)(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count);
+
+static void transform_points_scalar(const Matrix44f& m, const Vec4f* points, Vec4f* result,
+    int begin, int end) {
+
+    for (int n = begin; n < end; n++) {
+        Vec4f p = points[n];
+        for (int y = 0; y < 4; y++) {
+            result[n][y] = p.x * m[0][y] + p.y * m[1][y] + p.z * m[2][y] + m[3][y];
+        }
+    }
+}
+
+#if HAVE_X86_KERNELS
+
+// One point per iteration: x, y and z broadcast across a register each
+// and multiplied into m's rows.
+static void transform_points_sse(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count) {
+    const __m128 r0 = _mm_loadu_ps(m[0]);
+    const __m128 r1 = _mm_loadu_ps(m[1]);
+    const __m128 r2 = _mm_loadu_ps(m[2]);
+    const __m128 r3 = _mm_loadu_ps(m[3]);
+
+    for (int n = 0; n < count; n++) {
+        __m128 p = _mm_loadu_ps(&points[n].x);
+        __m128 v = _mm_mul_ps(_mm_shuffle_ps(p, p, 0x00), r0);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(p, p, 0x55), r1));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(p, p, 0xaa), r2));
+        v = _mm_add_ps(v, r3);
+        _mm_storeu_ps(&result[n].x, v);
+    }
+}
+
+// Two points per iteration, one per 128-bit lane, m's rows broadcast to
+// both lanes.
+__attribute__((target("avx")))
+static void transform_points_avx(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count) {
+    const __m256 r0 = _mm256_broadcast_ps((const __m128*)m[0]);
+    const __m256 r1 = _mm256_broadcast_ps((const __m128*)m[1]);
+    const __m256 r2 = _mm256_broadcast_ps((const __m128*)m[2]);
+    const __m256 r3 = _mm256_broadcast_ps((const __m128*)m[3]);
+
+    int n = 0;
+    for (; n + 2 <= count; n += 2) {
+        __m256 p = _mm256_loadu_ps(&points[n].x);
+        __m256 v = _mm256_mul_ps(_mm256_permute_ps(p, 0x00), r0);
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_permute_ps(p, 0x55), r1));
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_permute_ps(p, 0xaa), r2));
+        v = _mm256_add_ps(v, r3);
+        _mm256_storeu_ps(&result[n].x, v);
+    }
+
+    transform_points_scalar(m, points, result, n, count);
+}
+
+#else
+
+static void transform_points_scalar(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count) {
+    transform_points_scalar(m, points, result, 0, count);
+}
+
+#endif
+
+static TransformKernel get_transform_kernel() {
+#if HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return transform_points_avx;
+    }
+    return transform_points_sse;
+#else
+    return transform_points_scalar;
+#endif
+}
+
+void transform_points(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count) {
+    static const TransformKernel kernel = get_transform_kernel();
+    kernel(m, points, result, count);
+}
+
+void get_perspective_info(
+    float fov, float aspect_ratio, float near, float far,
+    float& b, float& t, float& l, float& r)
+{
+    float scale = tanf(fov * 0.5f * PI_F / 180) * near;
+    r = aspect_ratio * scale;
+    l = -r;
+    t = scale;
+    b = -t;
+}
+
+void calc_proj_matrix(
+    float b, float t, float l, float r, float n, float f,
+    Matrix44f& mat)
+{
+    // set OpenGL perspective projection matrix
+    memcpy(mat, proj_matrix(b, t, l, r, n, f).m, sizeof(mat));
+}
+
+void calc_lookat_matrix(
+    const Vec3f& pos, const Vec3f& at, const Vec3f& up,
+    Matrix44f& mat) {
+
+    Vec3f z_axis = (pos - at).norm();
+
+    Vec3f x_axis = up.cross(z_axis).norm();
+    Vec3f y_axis = z_axis.cross(x_axis);
+
+    memcpy(mat, lookat_matrix_from_axes(x_axis, y_axis, z_axis, pos).m, sizeof(mat));
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "vec_stuff.h"
+
+#define PI 3.141592653589793
+#define PI_F ((float)3.141592653589793)
+
+// Laid out as GL takes it from glUniformMatrix4fv: m[3] holds the
+// translation, and a point p transforms to the sum of p[i] * m[i].
+typedef float Matrix44f[4][4];
+
+void get_identity_matrix(Matrix44f& result);
+
+// result = m1 * m2, result may be either of them.
+void mult_matrices(
+    const Matrix44f& m1, const Matrix44f& m2,
+    Matrix44f& result);
+
+// m = m * (rotation about y), updating the two columns the rotation
+// mixes in place rather than building and multiplying the rotation.
+void add_y_rotation_to_matrix(Matrix44f& m, float rot);
+
+// m = m * (translation by offset), likewise in place.
+void add_translation_to_matrix(Matrix44f& m, const Vec3f& offset);
+
+// result[n] = points[n] transformed by m, for count points, with the
+// points' w taken as 1 (the cloth keeps mass there) and the transformed
+// w written out. result may be points. Uses AVX when the CPU has it.
+void transform_points(const Matrix44f& m, const Vec4f* points, Vec4f* result, int count);
+
+// fov is vertical, in degrees.
+void get_perspective_info(
+    float fov, float aspect_ratio, float near, float far,
+    float& b, float& t, float& l, float& r);
+void calc_proj_matrix(
+    float b, float t, float l, float r, float n, float f,
+    Matrix44f& mat);
+void calc_lookat_matrix(
+    const Vec3f& pos, const Vec3f& at, const Vec3f& up,
+    Matrix44f& mat);
+
+// A Matrix44f by value, so the builders below can be constexpr and a
+// camera made of constants becomes static data:
+//
+//   static constexpr Matrix44fValue view_proj = mult_matrices(
+//       lookat_matrix(pos, at, up), perspective_matrix(45, 4.0f / 3, 0.1f, 100));
+//
+// They are all float throughout and give what the functions above do to
+// within float rounding (tan and sqrt are evaluated by series here).
+struct Matrix44fValue {
+    Matrix44f m;
+
+    const Matrix44f& matrix() const { return m; }
+};
+
+// sqrtf by Newton's method, for constant expressions.
+constexpr float const_sqrt_newton(float x, float guess, int iterations) {
+    return iterations == 0 || guess == 0.5f * (guess + x / guess) ? guess :
+        const_sqrt_newton(x, 0.5f * (guess + x / guess), iterations - 1);
+}
+
+constexpr float const_sqrt(float x) {
+    return x <= 0.0f ? 0.0f : const_sqrt_newton(x, x >= 1.0f ? x : 1.0f, 64);
+}
+
+// tanf by the sine and cosine series, for constant expressions; good to
+// float precision for |x| <= PI / 2, which covers any field of view.
+constexpr float const_sin_series(float x, float x2) {
+    return x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72 *
+        (1 - x2 / 110 * (1 - x2 / 156 * (1 - x2 / 210)))))));
+}
+
+constexpr float const_cos_series(float x2) {
+    return 1 - x2 / 2 * (1 - x2 / 12 * (1 - x2 / 30 * (1 - x2 / 56 *
+        (1 - x2 / 90 * (1 - x2 / 132 * (1 - x2 / 182))))));
+}
+
+constexpr float const_tan(float x) {
+    return const_sin_series(x, x * x) / const_cos_series(x * x);
+}
+
+constexpr Vec3f const_norm(const Vec3f& v) {
+    return v / const_sqrt(v.dot(v));
+}
+
+constexpr Matrix44fValue identity_matrix() {
+    return Matrix44fValue{ {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 },
+    } };
+}
+
+constexpr float product_element(const Matrix44fValue& m1, const Matrix44fValue& m2, int x, int y) {
+    return m1.m[x][0] * m2.m[0][y] + m1.m[x][1] * m2.m[1][y] +
+        m1.m[x][2] * m2.m[2][y] + m1.m[x][3] * m2.m[3][y];
+}
+
+constexpr Matrix44fValue mult_matrices(const Matrix44fValue& m1, const Matrix44fValue& m2) {
+    return Matrix44fValue{ {
+        { product_element(m1, m2, 0, 0), product_element(m1, m2, 0, 1),
+          product_element(m1, m2, 0, 2), product_element(m1, m2, 0, 3) },
+        { product_element(m1, m2, 1, 0), product_element(m1, m2, 1, 1),
+          product_element(m1, m2, 1, 2), product_element(m1, m2, 1, 3) },
+        { product_element(m1, m2, 2, 0), product_element(m1, m2, 2, 1),
+          product_element(m1, m2, 2, 2), product_element(m1, m2, 2, 3) },
+        { product_element(m1, m2, 3, 0), product_element(m1, m2, 3, 1),
+          product_element(m1, m2, 3, 2), product_element(m1, m2, 3, 3) },
+    } };
+}
+
+// calc_proj_matrix() by value.
+constexpr Matrix44fValue proj_matrix(float b, float t, float l, float r, float n, float f) {
+    return Matrix44fValue{ {
+        { 2 * n / (r - l), 0, 0, 0 },
+        { 0, 2 * n / (t - b), 0, 0 },
+        { (r + l) / (r - l), (t + b) / (t - b), -(f + n) / (f - n), -1 },
+        { 0, 0, -2 * f * n / (f - n), 0 },
+    } };
+}
+
+// The frustum get_perspective_info() gives for a near plane scale high
+// above the axis.
+constexpr Matrix44fValue perspective_matrix_from_scale(float scale, float aspect_ratio,
+    float near, float far) {
+
+    return proj_matrix(-scale, scale, -aspect_ratio * scale, aspect_ratio * scale, near, far);
+}
+
+// get_perspective_info() and calc_proj_matrix() in one.
+constexpr Matrix44fValue perspective_matrix(float fov, float aspect_ratio, float near, float far) {
+    return perspective_matrix_from_scale(const_tan(fov * 0.5f * PI_F / 180) * near,
+        aspect_ratio, near, far);
+}
+
+// The look-at matrix for the camera's unit axes and position.
+constexpr Matrix44fValue lookat_matrix_from_axes(const Vec3f& x_axis, const Vec3f& y_axis,
+    const Vec3f& z_axis, const Vec3f& pos) {
+
+    return Matrix44fValue{ {
+        { x_axis.x, y_axis.x, z_axis.x, 0 },
+        { x_axis.y, y_axis.y, z_axis.y, 0 },
+        { x_axis.z, y_axis.z, z_axis.z, 0 },
+        { x_axis.dot(pos) * -1.0f, y_axis.dot(pos) * -1.0f, z_axis.dot(pos) * -1.0f, 1 },
+    } };
+}
+
+constexpr Matrix44fValue lookat_matrix_from_z_x(const Vec3f& z_axis, const Vec3f& x_axis,
+    const Vec3f& pos) {
+
+    return lookat_matrix_from_axes(x_axis, z_axis.cross(x_axis), z_axis, pos);
+}
+
+constexpr Matrix44fValue lookat_matrix_from_z_up(const Vec3f& z_axis, const Vec3f& up,
+    const Vec3f& pos) {
+
+    return lookat_matrix_from_z_x(z_axis, const_norm(up.cross(z_axis)), pos);
+}
+
+// calc_lookat_matrix() by value.
+constexpr Matrix44fValue lookat_matrix(const Vec3f& pos, const Vec3f& at, const Vec3f& up) {
+    return lookat_matrix_from_z_up(const_norm(pos - at), up, pos);
+}
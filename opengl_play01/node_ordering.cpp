@@ -0,0 +1,138 @@
+#include "node_ordering.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+const char* node_order_name(NodeOrder order) {
+    switch (order) {
+        case ORDER_ROW_MAJOR: return "row-major";
+        case ORDER_MORTON: return "morton";
+        case ORDER_HILBERT: return "hilbert";
+    }
+    return "?";
+}
+
+bool parse_node_order(const char* name, NodeOrder& order) {
+    if (strcmp(name, "row") == 0) {
+        order = ORDER_ROW_MAJOR;
+    }
+    else if (strcmp(name, "morton") == 0) {
+        order = ORDER_MORTON;
+    }
+    else if (strcmp(name, "hilbert") == 0) {
+        order = ORDER_HILBERT;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Spreads the low 16 bits of v out to the even bits.
+static uint32_t spread_bits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static uint32_t morton_key(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+// Distance along the Hilbert curve filling a side x side square (side a
+// power of two).
+static uint32_t hilbert_key(uint32_t side, uint32_t x, uint32_t y) {
+    uint32_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve inside it starts and ends at
+        // the right corners.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+void build_node_order(int points_x, int points_y, NodeOrder order, NodePermutation& permutation) {
+    permutation.to_grid.clear();
+    permutation.from_grid.clear();
+    if (order == ORDER_ROW_MAJOR) {
+        return;
+    }
+
+    uint32_t side = 1;
+    while (side < (uint32_t)std::max(points_x, points_y)) {
+        side *= 2;
+    }
+
+    int total = points_x * points_y;
+    std::vector<uint64_t> keyed(total);
+    for (int j = 0; j < points_y; j++) {
+        for (int i = 0; i < points_x; i++) {
+            uint32_t key = (order == ORDER_MORTON) ? morton_key(i, j) : hilbert_key(side, i, j);
+            int n = i + j * points_x;
+            keyed[n] = ((uint64_t)key << 32) | (uint32_t)n;
+        }
+    }
+    // Keys are unique, so this is a plain sort by curve position.
+    std::sort(keyed.begin(), keyed.end());
+
+    permutation.to_grid.resize(total);
+    permutation.from_grid.resize(total);
+    for (int n = 0; n < total; n++) {
+        int grid = (int)(keyed[n] & 0xffffffff);
+        permutation.to_grid[n] = grid;
+        permutation.from_grid[grid] = n;
+    }
+}
+
+template <typename T>
+static void permute_array(const std::vector<int>& to_grid, T* data) {
+    std::vector<T> source(data, data + to_grid.size());
+    for (size_t n = 0; n < to_grid.size(); n++) {
+        data[n] = source[to_grid[n]];
+    }
+}
+
+void permute_nodes(const NodePermutation& permutation, Vec4f* positions, Vec3f* velocities) {
+    if (permutation.is_identity()) {
+        return;
+    }
+    permute_array(permutation.to_grid, positions);
+    permute_array(permutation.to_grid, velocities);
+}
+
+void permute_topology(const NodePermutation& permutation, SpringTopology& topology) {
+    if (permutation.is_identity()) {
+        return;
+    }
+
+    SpringTopology source;
+    std::swap(source, topology);
+
+    topology.clear();
+    topology.neighbours.reserve(source.neighbours.size());
+    topology.coeffs.reserve(source.coeffs.size());
+
+    int count = source.nodes();
+    for (int n = 0; n < count; n++) {
+        int grid = permutation.to_grid[n];
+        for (int s = source.offsets[grid]; s < source.offsets[grid + 1]; s++) {
+            topology.add_spring(permutation.from_grid[source.neighbours[s]],
+                source.coeffs[s].rest_length, source.coeffs[s].stiffness);
+        }
+        topology.finish_node();
+    }
+}
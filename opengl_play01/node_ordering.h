@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "spring_topology.h"
+#include "vec_stuff.h"
+
+// How the cloth's nodes are numbered. Row-major is the generator's order;
+// the space-filling curves keep grid neighbours close in memory, so the
+// n +- points_x fetches stop landing a whole row apart.
+enum NodeOrder {
+    ORDER_ROW_MAJOR,
+    ORDER_MORTON,
+    ORDER_HILBERT
+};
+
+const char* node_order_name(NodeOrder order);
+// Accepts "row", "morton" or "hilbert".
+bool parse_node_order(const char* name, NodeOrder& order);
+
+// A renumbering of the nodes: to_grid[n] is the row-major index of node
+// n, from_grid[] the inverse.
+struct NodePermutation {
+    std::vector<int> to_grid;
+    std::vector<int> from_grid;
+
+    bool is_identity() const { return to_grid.empty(); }
+};
+
+// Fills permutation for a points_x * points_y grid. Row-major leaves it
+// empty (the identity).
+void build_node_order(int points_x, int points_y, NodeOrder order, NodePermutation& permutation);
+
+// Moves row-major data into permuted order, in place.
+void permute_nodes(const NodePermutation& permutation, Vec4f* positions, Vec3f* velocities);
+
+// Renumbers every node and neighbour of a row-major topology, keeping
+// each node's springs in their original order.
+void permute_topology(const NodePermutation& permutation, SpringTopology& topology);
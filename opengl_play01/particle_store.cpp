@@ -0,0 +1,84 @@
+#include "particle_store.h"
+
+#include <cstdlib>
+#include <new>
+
+#include "spring_topology.h"
+
+void* aligned_alloc_bytes(size_t bytes) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, PARTICLE_ALIGNMENT, bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void aligned_free_bytes(void* ptr) {
+    free(ptr);
+}
+
+void ParticleStore::resize(int count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    mass.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    vz.resize(count);
+}
+
+void ParticleStore::load(const Vec4f* positions_mass, const Vec3f* velocities) {
+    int count = size();
+    for (int n = 0; n < count; n++) {
+        x[n] = positions_mass[n].x;
+        y[n] = positions_mass[n].y;
+        z[n] = positions_mass[n].z;
+        mass[n] = positions_mass[n].w;
+        vx[n] = velocities[n].x;
+        vy[n] = velocities[n].y;
+        vz[n] = velocities[n].z;
+    }
+}
+
+void ParticleStore::store(Vec4f* positions_mass, Vec3f* velocities) const {
+    int count = size();
+    for (int n = 0; n < count; n++) {
+        positions_mass[n] = Vec4f(x[n], y[n], z[n], mass[n]);
+    }
+    if (velocities) {
+        for (int n = 0; n < count; n++) {
+            velocities[n] = Vec3f(vx[n], vy[n], vz[n]);
+        }
+    }
+}
+
+void ConnectionStore::resize(int count) {
+    for (int i = 0; i < 4; i++) {
+        slot[i].resize(count);
+        rest_length[i].resize(count);
+    }
+    inv_mass.resize(count);
+}
+
+void ConnectionStore::load(const Vec4i* connections, const SpringTopology& topology,
+    const float* inv_masses) {
+
+    int count = size();
+    for (int n = 0; n < count; n++) {
+        for (int i = 0; i < 4; i++) {
+            int other = connections[n][i];
+            slot[i][n] = other;
+            rest_length[i][n] = 0.0f;
+            if (other != -1) {
+                int spring = topology.find_spring(n, other);
+                assert(spring >= 0);
+                rest_length[i][n] = topology.coeffs[spring].rest_length;
+            }
+        }
+        inv_mass[n] = inv_masses[n];
+    }
+}
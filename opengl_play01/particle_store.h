@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#include "vec_stuff.h"
+
+// Alignment of every SoA stream. Enough for a full AVX-512 register.
+const size_t PARTICLE_ALIGNMENT = 64;
+
+void* aligned_alloc_bytes(size_t bytes);
+void aligned_free_bytes(void* ptr);
+
+// Fixed-size heap array aligned to PARTICLE_ALIGNMENT.
+template <typename T>
+class AlignedArray {
+public:
+    AlignedArray() : m_data(nullptr), m_size(0) {
+    }
+
+    ~AlignedArray() {
+        aligned_free_bytes(m_data);
+    }
+
+    AlignedArray(const AlignedArray&) = delete;
+    AlignedArray& operator=(const AlignedArray&) = delete;
+
+    void resize(size_t size) {
+        aligned_free_bytes(m_data);
+        m_data = (T*)aligned_alloc_bytes(size * sizeof(T));
+        m_size = size;
+    }
+
+    size_t size() const { return m_size; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+    T* m_data;
+    size_t m_size;
+};
+
+// Structure-of-arrays copy of one position/velocity buffer pair.
+struct ParticleStore {
+    AlignedArray<float> x;
+    AlignedArray<float> y;
+    AlignedArray<float> z;
+    AlignedArray<float> mass;
+    AlignedArray<float> vx;
+    AlignedArray<float> vy;
+    AlignedArray<float> vz;
+
+    void resize(int count);
+    int size() const { return (int)x.size(); }
+
+    void load(const Vec4f* positions_mass, const Vec3f* velocities);
+    // velocities may be null when only positions are wanted.
+    void store(Vec4f* positions_mass, Vec3f* velocities) const;
+};
+
+struct SpringTopology;
+
+// The constant per-node data: the four connection slots of every node and
+// the rest length of each slot's spring, one stream per slot, and each
+// node's inverse mass (0 when pinned).
+struct ConnectionStore {
+    AlignedArray<int> slot[4];
+    AlignedArray<float> rest_length[4];
+    AlignedArray<float> inv_mass;
+
+    void resize(int count);
+    int size() const { return (int)slot[0].size(); }
+
+    // Rest lengths are looked up in topology, which must hold every
+    // connection as a spring.
+    void load(const Vec4i* connections, const SpringTopology& topology, const float* inv_masses);
+};
@@ -0,0 +1,150 @@
+#include "pin_set.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "spring_mass_solver.h"
+
+const char* pin_layout_name(PinLayout layout) {
+    switch (layout) {
+        case PINS_TOP_ROW: return "top";
+        case PINS_TOP_CORNERS: return "corners";
+    }
+    return "?";
+}
+
+bool parse_pin_layout(const char* name, PinLayout& layout) {
+    if (strcmp(name, "top") == 0) {
+        layout = PINS_TOP_ROW;
+    }
+    else if (strcmp(name, "corners") == 0) {
+        layout = PINS_TOP_CORNERS;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+void PinSet::clear() {
+    pins.clear();
+    free_spans.clear();
+    pinned_spans.clear();
+    animated = false;
+}
+
+void PinSet::add(int node, const Vec3f& anchor, const Vec3f& sway) {
+    Pin pin;
+    pin.node = node;
+    pin.anchor = anchor;
+    pin.sway = sway;
+    pins.push_back(pin);
+
+    if (sway.x != 0.0f || sway.y != 0.0f || sway.z != 0.0f) {
+        animated = true;
+    }
+}
+
+void PinSet::finish(int node_count) {
+    std::sort(pins.begin(), pins.end(), [](const Pin& a, const Pin& b) { return a.node < b.node; });
+
+    free_spans.clear();
+    pinned_spans.clear();
+
+    int next = 0;
+    for (const Pin& pin : pins) {
+        assert(pin.node >= next && pin.node < node_count);
+        if (pin.node > next) {
+            free_spans.push_back(NodeSpan{ next, pin.node });
+        }
+        if (!pinned_spans.empty() && pinned_spans.back().end == pin.node) {
+            pinned_spans.back().end++;
+        }
+        else {
+            pinned_spans.push_back(NodeSpan{ pin.node, pin.node + 1 });
+        }
+        next = pin.node + 1;
+    }
+    if (next < node_count) {
+        free_spans.push_back(NodeSpan{ next, node_count });
+    }
+}
+
+bool PinSet::is_pinned(int node) const {
+    std::vector<Pin>::const_iterator pin = std::lower_bound(pins.begin(), pins.end(), node,
+        [](const Pin& pin, int node) { return pin.node < node; });
+    return pin != pins.end() && pin->node == node;
+}
+
+Vec3f PinSet::target(const Pin& pin, double time) const {
+    const double two_pi = 6.283185307179586;
+    float phase = (float)sin(two_pi * time / PIN_SWAY_PERIOD);
+    return pin.anchor + pin.sway * phase;
+}
+
+void PinSet::move(double time, Vec4f* positions) const {
+    for (const Pin& pin : pins) {
+        Vec3f p = target(pin, time);
+        positions[pin.node] = Vec4f(p.x, p.y, p.z, positions[pin.node].w);
+    }
+}
+
+void build_cloth_pins(int points_x, int points_y, const SpringParams& params, PinSet& pins) {
+    const Vec3f sway(params.pin_sway, 0.0f, 0.0f);
+    const int top = points_y - 1;
+
+    pins.clear();
+    for (int i = 0; i < points_x; i++) {
+        if (params.pins == PINS_TOP_CORNERS && i != 0 && i != points_x - 1) {
+            continue;
+        }
+        Vec4f p = cloth_grid_position(points_x, points_y, i, top);
+        pins.add(i + top * points_x, Vec3f(p.x, p.y, p.z), sway);
+    }
+    pins.finish(points_x * points_y);
+}
+
+void order_pins_last(const PinSet& pins, int node_count, NodePermutation& permutation) {
+    if (pins.empty()) {
+        return;
+    }
+
+    // Row-major index of each node in the new order.
+    std::vector<int> order = permutation.to_grid;
+    if (permutation.is_identity()) {
+        order.resize(node_count);
+        for (int n = 0; n < node_count; n++) {
+            order[n] = n;
+        }
+    }
+    std::stable_partition(order.begin(), order.end(),
+        [&pins](int grid) { return !pins.is_pinned(grid); });
+
+    bool identity = true;
+    for (int n = 0; n < node_count && identity; n++) {
+        identity = (order[n] == n);
+    }
+    if (identity) {
+        permutation.to_grid.clear();
+        permutation.from_grid.clear();
+        return;
+    }
+
+    permutation.from_grid.resize(node_count);
+    for (int n = 0; n < node_count; n++) {
+        permutation.from_grid[order[n]] = n;
+    }
+    permutation.to_grid.swap(order);
+}
+
+void permute_pins(const NodePermutation& permutation, PinSet& pins) {
+    if (permutation.is_identity()) {
+        return;
+    }
+
+    for (Pin& pin : pins.pins) {
+        pin.node = permutation.from_grid[pin.node];
+    }
+    pins.finish((int)permutation.from_grid.size());
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "node_ordering.h"
+#include "vec_stuff.h"
+
+struct SpringParams;
+
+// Which of the cloth's nodes build_cloth_pins() holds.
+enum PinLayout {
+    // The whole top row, like a curtain on a rail.
+    PINS_TOP_ROW,
+    // Just the two top corners, so the top edge sags between them.
+    PINS_TOP_CORNERS
+};
+
+const char* pin_layout_name(PinLayout layout);
+// Accepts "top" or "corners".
+bool parse_pin_layout(const char* name, PinLayout& layout);
+
+// Simulated time of one full swing of a swaying pin: about 3 seconds at
+// the default 960 steps of 0.07 a second.
+const float PIN_SWAY_PERIOD = 200.0f;
+
+// A node that is held rather than integrated. Its target is anchor, moved
+// by sway * sin(2 pi time / PIN_SWAY_PERIOD) when sway is non-zero.
+struct Pin {
+    int node;
+    Vec3f anchor;
+    Vec3f sway;
+};
+
+// Nodes [begin, end).
+struct NodeSpan {
+    int begin;
+    int end;
+};
+
+// The explicit set of pinned nodes. The solvers only ever step the free
+// spans, the runs of nodes between the pins, so a pinned node costs
+// nothing per step; a swaying one costs the write of its new target.
+// Build it with clear(), add() for each pin and finish().
+struct PinSet {
+    // Sorted by node once finished.
+    std::vector<Pin> pins;
+    // The runs of free nodes and of pinned ones, in node order.
+    std::vector<NodeSpan> free_spans;
+    std::vector<NodeSpan> pinned_spans;
+    bool animated;
+
+    PinSet() : animated(false) {
+    }
+
+    int size() const { return (int)pins.size(); }
+    bool empty() const { return pins.empty(); }
+
+    void clear();
+    void add(int node, const Vec3f& anchor, const Vec3f& sway = Vec3f());
+    // Sorts the pins and splits nodes [0, node_count) into spans.
+    void finish(int node_count);
+
+    bool is_pinned(int node) const;
+    // One past the last free node; the nodes after it are all pinned.
+    int active_end() const { return free_spans.empty() ? 0 : free_spans.back().end; }
+
+    Vec3f target(const Pin& pin, double time) const;
+    // Moves every pinned node of positions to its target at time, keeping
+    // its mass. Only needed when animated; static pins never move.
+    void move(double time, Vec4f* positions) const;
+
+    // Calls func(span_begin, span_end) for each run of free nodes within
+    // [begin, end), so a block of a parallel loop skips the pins in it.
+    template <typename Func>
+    void for_free_spans(int begin, int end, Func func) const {
+        std::vector<NodeSpan>::const_iterator span = std::upper_bound(
+            free_spans.begin(), free_spans.end(), begin,
+            [](int node, const NodeSpan& span) { return node < span.end; });
+        for (; span != free_spans.end() && span->begin < end; ++span) {
+            func(std::max(span->begin, begin), std::min(span->end, end));
+        }
+    }
+};
+
+// Fills pins for a points_x * points_y cloth from params.pins, anchored
+// where init_cloth_grid() puts the nodes and swaying along x by
+// params.pin_sway. Nodes are numbered row-major.
+void build_cloth_pins(int points_x, int points_y, const SpringParams& params, PinSet& pins);
+
+// Renumbers a row-major pin set into permutation's node order.
+void permute_pins(const NodePermutation& permutation, PinSet& pins);
+
+// Moves the nodes of a row-major pin set to the end of permutation,
+// keeping the free nodes in their order, so pins.active_end() excludes
+// every pin once permuted. For the GPU passes, which can only skip a
+// tail of the nodes. Leaves permutation empty if it comes out as the
+// identity (row-major with the top row pinned).
+void order_pins_last(const PinSet& pins, int node_count, NodePermutation& permutation);
@@ -0,0 +1,146 @@
+#include "position_readback.h"
+
+#include <cstdio>
+#include <iostream>
+
+PositionReadback::PositionReadback()
+    : m_points(0), m_next(0), m_acquired(-1), m_newest_frame(0) {
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        m_buffers[i] = 0;
+        m_mapped[i] = nullptr;
+        m_slots[i].fence = 0;
+        m_slots[i].frame = 0;
+    }
+}
+
+PositionReadback::~PositionReadback() {
+    destroy();
+}
+
+bool PositionReadback::supported() {
+    return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+bool PositionReadback::create(int points) {
+    destroy();
+    if (!supported()) {
+        return false;
+    }
+
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr bytes = (GLsizeiptr)points * sizeof(Vec4f);
+
+    m_points = points;
+    glGenBuffers(BUFFER_COUNT, m_buffers);
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffers[i]);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, flags);
+        m_mapped[i] = (const Vec4f*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+        if (!m_mapped[i]) {
+            std::cout << "couldn't map the readback buffers" << std::endl;
+            destroy();
+            return false;
+        }
+    }
+
+    m_next = 0;
+    m_acquired = -1;
+    m_newest_frame = 0;
+    return true;
+}
+
+void PositionReadback::destroy() {
+    if (!m_buffers[0]) {
+        return;
+    }
+
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        release_fence(m_slots[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffers[i]);
+        if (m_mapped[i]) {
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        m_mapped[i] = nullptr;
+    }
+    glDeleteBuffers(BUFFER_COUNT, m_buffers);
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        m_buffers[i] = 0;
+    }
+}
+
+void PositionReadback::release_fence(Slot& slot) {
+    if (slot.fence) {
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+}
+
+void PositionReadback::capture(GLuint source, uint64_t frame) {
+    // Never write into the copy the caller is reading.
+    if (m_next == m_acquired) {
+        m_next = (m_next + 1) % BUFFER_COUNT;
+    }
+
+    Slot& slot = m_slots[m_next];
+    // An older copy still in flight here is simply superseded; the GPU
+    // runs the two copies in order.
+    release_fence(slot);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffers[m_next]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+        (GLsizeiptr)m_points * sizeof(Vec4f));
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frame;
+    slot.captured = std::chrono::steady_clock::now();
+    m_newest_frame = frame;
+
+    m_next = (m_next + 1) % BUFFER_COUNT;
+}
+
+const Vec4f* PositionReadback::acquire_latest_positions(uint64_t* frame) {
+    int newest = -1;
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        Slot& slot = m_slots[i];
+        if (!slot.fence || (newest >= 0 && slot.frame < m_slots[newest].frame)) {
+            continue;
+        }
+
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            newest = i;
+        }
+    }
+
+    if (newest < 0) {
+        return nullptr;
+    }
+
+    // Copies older than the one handed out are of no more use.
+    Slot& acquired = m_slots[newest];
+    for (int i = 0; i < BUFFER_COUNT; i++) {
+        if (i != newest && m_slots[i].fence && m_slots[i].frame < acquired.frame) {
+            release_fence(m_slots[i]);
+        }
+    }
+    release_fence(acquired);
+    m_acquired = newest;
+
+    m_latency_frames.add((double)(m_newest_frame - acquired.frame));
+    m_latency_ms.add(std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - acquired.captured).count());
+
+    if (frame) {
+        *frame = acquired.frame;
+    }
+    return m_mapped[newest];
+}
+
+void PositionReadback::print_latency(std::ostream& out) const {
+    char line[160];
+    snprintf(line, sizeof(line), "readback latency: p50 %.1f  p95 %.1f frames, p50 %.3f  p95 %.3f ms",
+        m_latency_frames.percentile(50), m_latency_frames.percentile(95),
+        m_latency_ms.percentile(50), m_latency_ms.percentile(95));
+    out << line << std::endl;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+
+#include <GL/glew.h>
+
+#include "profiler.h"
+#include "vec_stuff.h"
+
+// Non-blocking GPU to CPU copies of the position buffer. Each capture()
+// queues a copy into one of three persistently mapped buffers and drops a
+// fence behind it; acquire_latest_positions() polls the fences and hands
+// out the newest copy the GPU has finished, never waiting. The buffer
+// being read is kept out of the rotation until the next acquire, so the
+// GPU always has one to write while another is in flight.
+class PositionReadback {
+public:
+    static const int BUFFER_COUNT = 3;
+
+    PositionReadback();
+    ~PositionReadback();
+
+    PositionReadback(const PositionReadback&) = delete;
+    PositionReadback& operator=(const PositionReadback&) = delete;
+
+    // Needs GL 4.4 or ARB_buffer_storage; returns false without it.
+    static bool supported();
+
+    bool create(int points);
+    void destroy();
+    bool is_created() const { return m_buffers[0] != 0; }
+
+    // Queues a copy of source (points Vec4fs) tagged with frame.
+    void capture(GLuint source, uint64_t frame);
+
+    // The newest completed copy, or null if none has completed since
+    // the last call. The pointer stays valid until the next call. frame,
+    // if given, gets the frame number the copy was captured at.
+    const Vec4f* acquire_latest_positions(uint64_t* frame = nullptr);
+
+    // Frames and milliseconds between capture and acquire.
+    const RollingStats& latency_frames() const { return m_latency_frames; }
+    const RollingStats& latency_ms() const { return m_latency_ms; }
+    void print_latency(std::ostream& out) const;
+
+private:
+    struct Slot {
+        GLsync fence;
+        uint64_t frame;
+        std::chrono::steady_clock::time_point captured;
+    };
+
+    void release_fence(Slot& slot);
+
+    int m_points;
+    GLuint m_buffers[BUFFER_COUNT];
+    const Vec4f* m_mapped[BUFFER_COUNT];
+    Slot m_slots[BUFFER_COUNT];
+
+    int m_next;
+    int m_acquired;
+    uint64_t m_newest_frame;
+
+    RollingStats m_latency_frames;
+    RollingStats m_latency_ms;
+};
@@ -0,0 +1,203 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+RollingStats::RollingStats(size_t capacity)
+    : m_samples(capacity), m_next(0), m_count(0) {
+}
+
+void RollingStats::add(double value) {
+    m_samples[m_next] = value;
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+double RollingStats::percentile(double p) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    std::vector<double> sorted(m_samples.begin(), m_samples.begin() + m_count);
+    size_t rank = (size_t)(p / 100.0 * (m_count - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+FrameProfiler::FrameProfiler()
+    : m_gpu_timers(GLEW_VERSION_3_3 || GLEW_ARB_timer_query),
+      m_epoch(std::chrono::steady_clock::now()),
+      m_frame(0), m_frame_start_us(0), m_in_phase(false) {
+}
+
+FrameProfiler::~FrameProfiler() {
+    if (!m_all_queries.empty()) {
+        glDeleteQueries((GLsizei)m_all_queries.size(), m_all_queries.data());
+    }
+}
+
+double FrameProfiler::now_us() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+GLuint FrameProfiler::get_query() {
+    if (m_free_queries.empty()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        m_all_queries.push_back(query);
+        return query;
+    }
+
+    GLuint query = m_free_queries.back();
+    m_free_queries.pop_back();
+    return query;
+}
+
+void FrameProfiler::add_stats(std::map<std::string, RollingStats>& stats, const char* name, double value) {
+    stats[name].add(value);
+}
+
+void FrameProfiler::finish_event(const Event& event) {
+    if (m_events.size() < MAX_TRACE_EVENTS) {
+        m_events.push_back(event);
+    }
+    if (event.gpu_us >= 0) {
+        add_stats(m_gpu_stats, event.name, event.gpu_us);
+    }
+}
+
+void FrameProfiler::begin_frame() {
+    m_frame_start_us = now_us();
+}
+
+void FrameProfiler::end_frame() {
+    m_frame_stats.add((now_us() - m_frame_start_us) / 1000.0);
+    m_frame++;
+    collect_queries(false);
+}
+
+void FrameProfiler::begin_phase(const char* name) {
+    m_current.name = name;
+    m_current.frame = m_frame;
+    m_current.gpu_us = -1;
+    m_current.query = 0;
+    m_in_phase = true;
+
+    if (m_gpu_timers) {
+        m_current.query = get_query();
+        glBeginQuery(GL_TIME_ELAPSED, m_current.query);
+    }
+
+    m_current.start_us = now_us();
+}
+
+void FrameProfiler::end_phase() {
+    if (!m_in_phase) {
+        return;
+    }
+
+    m_current.cpu_us = now_us() - m_current.start_us;
+    m_in_phase = false;
+
+    add_stats(m_cpu_stats, m_current.name, m_current.cpu_us);
+
+    if (m_current.query) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_pending.push_back(m_current);
+    }
+    else {
+        finish_event(m_current);
+    }
+}
+
+// Queries complete in submission order, so stop at the first one that
+// isn't ready unless told to wait.
+void FrameProfiler::collect_queries(bool wait) {
+    while (!m_pending.empty()) {
+        Event& event = m_pending.front();
+
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(event.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(event.query, GL_QUERY_RESULT, &elapsed_ns);
+        event.gpu_us = elapsed_ns / 1000.0;
+
+        m_free_queries.push_back(event.query);
+        finish_event(event);
+        m_pending.pop_front();
+    }
+}
+
+static void print_percentiles(std::ostream& out, const char* label, const RollingStats& stats, double scale) {
+    char line[160];
+    snprintf(line, sizeof(line), "  %-24s p50 %9.3f  p95 %9.3f  p99 %9.3f ms",
+        label, stats.percentile(50) * scale, stats.percentile(95) * scale, stats.percentile(99) * scale);
+    out << line << std::endl;
+}
+
+void FrameProfiler::print_summary(std::ostream& out) const {
+    out << "profile after " << m_frame << " frames (last " << m_frame_stats.count() << "):" << std::endl;
+    print_percentiles(out, "frame (cpu)", m_frame_stats, 1.0);
+
+    for (const auto& entry : m_cpu_stats) {
+        print_percentiles(out, (entry.first + " (cpu)").c_str(), entry.second, 0.001);
+    }
+    for (const auto& entry : m_gpu_stats) {
+        print_percentiles(out, (entry.first + " (gpu)").c_str(), entry.second, 0.001);
+    }
+}
+
+static void write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+bool FrameProfiler::write_chrome_trace(const char* path) {
+    collect_queries(true);
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        std::cout << "couldn't open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    const int pid = 1;
+    const int cpu_tid = 1;
+    const int gpu_tid = 2;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"CPU\"}},\n", pid, cpu_tid);
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", pid, gpu_tid);
+
+    for (const Event& event : m_events) {
+        fprintf(file, ",\n{\"name\":");
+        write_json_string(file, event.name);
+        fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"frame\":%d}}",
+            event.start_us, event.cpu_us, pid, cpu_tid, event.frame);
+
+        if (event.gpu_us >= 0) {
+            fprintf(file, ",\n{\"name\":");
+            write_json_string(file, event.name);
+            fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"frame\":%d}}",
+                event.start_us, event.gpu_us, pid, gpu_tid, event.frame);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return true;
+}
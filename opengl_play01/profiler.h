@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Fixed-size window over the most recent samples.
+class RollingStats {
+public:
+    explicit RollingStats(size_t capacity = 600);
+
+    void add(double value);
+    size_t count() const { return m_count; }
+
+    // p in [0, 100], over the samples currently in the window.
+    double percentile(double p) const;
+
+private:
+    std::vector<double> m_samples;
+    size_t m_next;
+    size_t m_count;
+};
+
+// Instrumenting profiler for the frame loop. Every phase gets its CPU wall
+// time and, when the context has timer queries, its GPU time from a
+// GL_TIME_ELAPSED query. Query results are collected a few frames late so
+// reading them never stalls the pipeline.
+//
+// The Chrome trace puts CPU phases on one track and GPU phases on another.
+// GL_TIME_ELAPSED only gives a duration, so GPU events are drawn starting
+// where their CPU phase started. The trace keeps the first
+// MAX_TRACE_EVENTS phases. The percentile summary keeps the last 600
+// samples of each phase and of frame time (RollingStats' window), one
+// sample per begin_phase(); phases entered once per substep, like
+// "update substep" and "update dispatch", so cover only the last few
+// dozen frames, each sample being one substep or dispatch.
+class FrameProfiler {
+public:
+    static const size_t MAX_TRACE_EVENTS = 1000000;
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    bool gpu_timers() const { return m_gpu_timers; }
+
+    void begin_frame();
+    void end_frame();
+
+    // Phases must not overlap: GL allows only one GL_TIME_ELAPSED query
+    // at a time.
+    void begin_phase(const char* name);
+    void end_phase();
+
+    int frame_count() const { return m_frame; }
+
+    // Percentiles of frame time and of every phase, CPU and GPU, over the
+    // last 600 samples of each.
+    void print_summary(std::ostream& out) const;
+
+    // Waits for outstanding queries, then writes a trace_event JSON file
+    // that chrome://tracing and Perfetto can load.
+    bool write_chrome_trace(const char* path);
+
+private:
+    struct Event {
+        const char* name;
+        int frame;
+        double start_us;
+        double cpu_us;
+        double gpu_us;
+        GLuint query;
+    };
+
+    double now_us() const;
+    GLuint get_query();
+    void collect_queries(bool wait);
+    void add_stats(std::map<std::string, RollingStats>& stats, const char* name, double value);
+    void finish_event(const Event& event);
+
+    bool m_gpu_timers;
+    std::chrono::steady_clock::time_point m_epoch;
+
+    int m_frame;
+    double m_frame_start_us;
+    Event m_current;
+    bool m_in_phase;
+
+    std::vector<Event> m_events;
+    std::deque<Event> m_pending;
+    std::vector<GLuint> m_free_queries;
+    std::vector<GLuint> m_all_queries;
+
+    RollingStats m_frame_stats;
+    std::map<std::string, RollingStats> m_cpu_stats;
+    std::map<std::string, RollingStats> m_gpu_stats;
+};
+
+// Times the enclosing scope as one phase. A null profiler makes it a no-op.
+class ProfilePhase {
+public:
+    ProfilePhase(FrameProfiler* profiler, const char* name) : m_profiler(profiler) {
+        if (m_profiler) {
+            m_profiler->begin_phase(name);
+        }
+    }
+
+    ~ProfilePhase() {
+        if (m_profiler) {
+            m_profiler->end_phase();
+        }
+    }
+
+private:
+    FrameProfiler* m_profiler;
+};
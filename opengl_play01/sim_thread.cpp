@@ -0,0 +1,211 @@
+#include "sim_thread.h"
+
+#include <algorithm>
+
+SimulationThread::SimulationThread()
+    : m_points_total(0), m_tick_seconds(0), m_substeps_per_tick(0),
+      m_adaptive(false), m_tick_time(0), m_quit(false), m_ticks(0), m_late_ticks(0), m_states_seen(0) {
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start(int points_x, int points_y, const SpringParams& params,
+    const NodePermutation& permutation, double tick_rate, int substeps_per_tick,
+    const AdaptiveStepLimits* adaptive, SimIntegrator integrator,
+    ImplicitSolve solve, float relax_weight) {
+
+    stop();
+
+    m_points_total = points_x * points_y;
+    m_tick_seconds = 1.0 / tick_rate;
+    m_substeps_per_tick = substeps_per_tick;
+
+    m_soa_solver.reset();
+    m_csr_solver.reset();
+    m_implicit_solver.reset();
+    m_xpbd_solver.reset();
+    m_pool.reset();
+
+    if (integrator == INTEGRATOR_IMPLICIT) {
+        m_implicit_solver.reset(new ImplicitSolver(points_x, points_y));
+        m_implicit_solver->params() = params;
+        m_implicit_solver->params().t = substeps_per_tick * params.t;
+        m_implicit_solver->reset();
+        m_implicit_solver->set_solve(solve, relax_weight);
+        m_pool.reset(new ThreadPool(ThreadPool::hardware_threads()));
+        m_implicit_solver->set_thread_pool(m_pool.get());
+    }
+    else if (integrator == INTEGRATOR_XPBD) {
+        m_xpbd_solver.reset(new XpbdSolver(points_x, points_y));
+        m_xpbd_solver->params() = params;
+        m_xpbd_solver->reset();
+        m_xpbd_solver->set_iterations(1);
+        m_pool.reset(new ThreadPool(ThreadPool::hardware_threads()));
+        m_xpbd_solver->set_thread_pool(m_pool.get());
+    }
+    // The SoA kernels only know the 4-connected grid.
+    else if (params.k_shear == 0.0f && params.k_bend == 0.0f) {
+        m_soa_solver.reset(new SoaSpringSolver(points_x, points_y));
+        m_soa_solver->params() = params;
+        m_soa_solver->reset();
+        m_pool.reset(new ThreadPool(ThreadPool::hardware_threads()));
+        m_soa_solver->set_thread_pool(m_pool.get());
+        m_grid_positions.resize(m_points_total);
+    }
+    else {
+        m_csr_solver.reset(new SpringMassSolver(points_x, points_y));
+        m_csr_solver->params() = params;
+        m_csr_solver->reset();
+    }
+    m_permutation = permutation;
+
+    m_adaptive = (adaptive != nullptr);
+    m_tick_time = substeps_per_tick * params.t;
+    if (adaptive) {
+        build_cloth_topology(points_x, points_y, params, m_topology);
+        build_cloth_pins(points_x, points_y, params, m_pins);
+        m_stepper_limits = *adaptive;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        m_states.buffer(i).positions.resize(m_points_total);
+    }
+    m_previous.positions.resize(m_points_total);
+    m_latest.positions.resize(m_points_total);
+    m_states_seen = 0;
+
+    m_ticks = 0;
+    m_late_ticks = 0;
+    m_quit = false;
+    m_start = clock::now();
+
+    // Tick 0 is the starting state, so there's something to draw at once.
+    step_and_publish(0);
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (m_thread.joinable()) {
+        m_quit = true;
+        m_thread.join();
+    }
+}
+
+double SimulationThread::elapsed_seconds() const {
+    return std::chrono::duration<double>(clock::now() - m_start).count();
+}
+
+void SimulationThread::step_and_publish(uint64_t tick) {
+    if (tick > 0) {
+        int substeps = m_substeps_per_tick;
+        if (m_adaptive) {
+            substeps = m_stepper.substeps(m_tick_time);
+        }
+
+        if (m_implicit_solver) {
+            m_implicit_solver->step();
+        }
+        else if (m_xpbd_solver) {
+            m_xpbd_solver->step(substeps);
+        }
+        else if (m_soa_solver) {
+            m_soa_solver->params().t = m_tick_time / substeps;
+            m_soa_solver->step(substeps);
+        }
+        else {
+            m_csr_solver->params().t = m_tick_time / substeps;
+            m_csr_solver->step(substeps);
+        }
+    }
+
+    const Vec4f* grid;
+    if (m_implicit_solver) {
+        grid = m_implicit_solver->positions();
+    }
+    else if (m_xpbd_solver) {
+        grid = m_xpbd_solver->positions();
+    }
+    else if (m_soa_solver) {
+        m_soa_solver->read_back(m_grid_positions.data(), nullptr);
+        grid = m_grid_positions.data();
+    }
+    else {
+        grid = m_csr_solver->positions();
+    }
+
+    if (m_adaptive) {
+        if (tick == 0) {
+            m_stepper.start(m_topology, m_pins, grid, m_csr_solver ? m_csr_solver->params().c :
+                m_soa_solver->params().c, m_stepper_limits);
+        }
+        else {
+            m_stepper.observe(grid, m_tick_time);
+        }
+    }
+
+    // Both solvers work in row-major order; the GL buffers may not.
+    SimState& state = m_states.write_buffer();
+    if (m_permutation.is_identity()) {
+        std::copy(grid, grid + m_points_total, state.positions.begin());
+    }
+    else {
+        for (int n = 0; n < m_points_total; n++) {
+            state.positions[n] = grid[m_permutation.to_grid[n]];
+        }
+    }
+    state.tick = tick;
+    state.time = tick * m_tick_seconds;
+    m_states.publish();
+
+    m_ticks.store(tick, std::memory_order_relaxed);
+}
+
+void SimulationThread::run() {
+    for (uint64_t tick = 1; !m_quit; tick++) {
+        clock::time_point due = m_start +
+            std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(tick * m_tick_seconds));
+
+        if (clock::now() > due) {
+            m_late_ticks.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            std::this_thread::sleep_until(due);
+        }
+
+        step_and_publish(tick);
+    }
+}
+
+void SimulationThread::interpolate(Vec4f* positions) {
+    if (m_states.update()) {
+        const SimState& state = m_states.read_buffer();
+        std::swap(m_previous, m_latest);
+        m_latest.positions.assign(state.positions.begin(), state.positions.end());
+        m_latest.tick = state.tick;
+        m_latest.time = state.time;
+        m_states_seen++;
+    }
+
+    if (m_states_seen < 2) {
+        std::copy(m_latest.positions.begin(), m_latest.positions.end(), positions);
+        return;
+    }
+
+    // Drawing one tick behind means there's (nearly) always a state on
+    // either side of the moment being drawn. If the renderer missed
+    // ticks, previous is older and the blend just covers a longer span.
+    double render_time = elapsed_seconds() - m_tick_seconds;
+    double span = m_latest.time - m_previous.time;
+    float alpha = (float)std::min(std::max((render_time - m_previous.time) / span, 0.0), 1.0);
+
+    const Vec4f* a = m_previous.positions.data();
+    const Vec4f* b = m_latest.positions.data();
+    for (int n = 0; n < m_points_total; n++) {
+        positions[n] = Vec4f(a[n].x + (b[n].x - a[n].x) * alpha,
+                             a[n].y + (b[n].y - a[n].y) * alpha,
+                             a[n].z + (b[n].z - a[n].z) * alpha,
+                             b[n].w);
+    }
+}
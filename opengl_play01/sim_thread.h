@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "adaptive_stepper.h"
+#include "config.h"
+#include "implicit_solver.h"
+#include "node_ordering.h"
+#include "soa_spring_solver.h"
+#include "spring_mass_solver.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+#include "xpbd_solver.h"
+#include "vec_stuff.h"
+
+// One finished simulation tick, in the order the GL buffers use.
+struct SimState {
+    std::vector<Vec4f> positions;
+    uint64_t tick;
+    // Simulated seconds since start() at the end of this tick.
+    double time;
+};
+
+// Runs the CPU solver on its own thread at a fixed tick rate, publishing
+// every tick through a triple buffer. The render thread picks up states
+// whenever it likes and draws positions interpolated between the last
+// two, one tick behind real time, so neither side paces the other.
+class SimulationThread {
+public:
+    SimulationThread();
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // The plain grid runs on the SoA solver across a thread pool; shear
+    // and bend springs need the CSR reference solver. permutation is the
+    // node order of the GL buffers. Each tick covers substeps_per_tick
+    // steps of params.t; given adaptive limits, an AdaptiveStepper splits
+    // that time into however many substeps the cloth needs instead.
+    // The implicit integrator covers each tick with one ImplicitSolver
+    // step instead, solved by solve with relaxation weight relax_weight,
+    // and XPBD runs the same substeps as XpbdSolver steps.
+    void start(int points_x, int points_y, const SpringParams& params,
+        const NodePermutation& permutation, double tick_rate, int substeps_per_tick,
+        const AdaptiveStepLimits* adaptive = nullptr,
+        SimIntegrator integrator = INTEGRATOR_EXPLICIT,
+        ImplicitSolve solve = SOLVE_CG, float relax_weight = 1.0f);
+    void stop();
+
+    // Render thread: fills positions (points_total Vec4fs) for the
+    // current moment.
+    void interpolate(Vec4f* positions);
+
+    // Ticks simulated since start(), not counting the starting state.
+    uint64_t ticks() const { return m_ticks.load(std::memory_order_relaxed); }
+    // Ticks that started late because the one before overran.
+    uint64_t late_ticks() const { return m_late_ticks.load(std::memory_order_relaxed); }
+    double elapsed_seconds() const;
+
+    // Solve iterations so far when implicit; only meaningful once stopped.
+    const ImplicitSolver* implicit_solver() const { return m_implicit_solver.get(); }
+
+    // Substep counts chosen so far; only meaningful once stopped.
+    bool adaptive() const { return m_adaptive; }
+    const AdaptiveStepper& stepper() const { return m_stepper; }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    void run();
+    void step_and_publish(uint64_t tick);
+
+    int m_points_total;
+    double m_tick_seconds;
+    int m_substeps_per_tick;
+    NodePermutation m_permutation;
+
+    bool m_adaptive;
+    // Simulated time per tick, and the row-major spring graph and pins
+    // the stepper measures the cloth with.
+    float m_tick_time;
+    SpringTopology m_topology;
+    PinSet m_pins;
+    AdaptiveStepLimits m_stepper_limits;
+    AdaptiveStepper m_stepper;
+
+    std::unique_ptr<ThreadPool> m_pool;
+    std::unique_ptr<SoaSpringSolver> m_soa_solver;
+    std::unique_ptr<SpringMassSolver> m_csr_solver;
+    std::unique_ptr<ImplicitSolver> m_implicit_solver;
+    std::unique_ptr<XpbdSolver> m_xpbd_solver;
+    std::vector<Vec4f> m_grid_positions;
+
+    TripleBuffer<SimState> m_states;
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<uint64_t> m_ticks;
+    std::atomic<uint64_t> m_late_ticks;
+    clock::time_point m_start;
+
+    // Render thread only: the two newest states.
+    SimState m_previous;
+    SimState m_latest;
+    int m_states_seen;
+};
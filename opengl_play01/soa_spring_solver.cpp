@@ -0,0 +1,365 @@
+#include "soa_spring_solver.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+// Same arithmetic, in the same order, as update_spring_node().
+static void spring_kernel_scalar(
+    const SpringParams& params, const ParticleStore& src,
+    const ConnectionStore& connections, ParticleStore& dst,
+    int begin, int end) {
+
+    float t = params.t;
+
+    for (int n = begin; n < end; n++) {
+        float px = src.x[n];
+        float py = src.y[n];
+        float pz = src.z[n];
+        float m = src.mass[n];
+        float ux = src.vx[n];
+        float uy = src.vy[n];
+        float uz = src.vz[n];
+
+        float Fx = 0.0f * m - ux * params.c;
+        float Fy = GRAVITY_Y * m - uy * params.c;
+        float Fz = 0.0f * m - uz * params.c;
+
+        for (int i = 0; i < 4; i++) {
+            int other = connections.slot[i][n];
+            if (other != -1) {
+                float dx = src.x[other] - px;
+                float dy = src.y[other] - py;
+                float dz = src.z[other] - pz;
+                float x = sqrtf(dx * dx + dy * dy + dz * dz);
+                float f = -params.k * (connections.rest_length[i][n] - x);
+                Fx += (dx / x) * f;
+                Fy += (dy / x) * f;
+                Fz += (dz / x) * f;
+            }
+        }
+
+        float w = connections.inv_mass[n];
+        float ax = Fx * w;
+        float ay = Fy * w;
+        float az = Fz * w;
+
+        float sx = ux * t + ax * 0.5f * t * t;
+        float sy = uy * t + ay * 0.5f * t * t;
+        float sz = uz * t + az * 0.5f * t * t;
+
+        sx = std::min(std::max(sx, -25.0f), 25.0f);
+        sy = std::min(std::max(sy, -25.0f), 25.0f);
+        sz = std::min(std::max(sz, -25.0f), 25.0f);
+
+        dst.x[n] = px + sx;
+        dst.y[n] = py + sy;
+        dst.z[n] = pz + sz;
+        dst.mass[n] = m;
+        dst.vx[n] = ux + ax * t;
+        dst.vy[n] = uy + ay * t;
+        dst.vz[n] = uz + az * t;
+    }
+}
+
+#if HAVE_X86_KERNELS
+
+// 8 nodes per iteration. Missing neighbours are masked out of the gathers
+// and of the force sum, so the -1 slots never touch memory.
+__attribute__((target("avx2")))
+static void spring_kernel_avx2(
+    const SpringParams& params, const ParticleStore& src,
+    const ConnectionStore& connections, ParticleStore& dst,
+    int begin, int end) {
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 gravity_y = _mm256_set1_ps(GRAVITY_Y);
+    const __m256 c = _mm256_set1_ps(params.c);
+    const __m256 neg_k = _mm256_set1_ps(-params.k);
+    const __m256 t = _mm256_set1_ps(params.t);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 clamp_lo = _mm256_set1_ps(-25.0f);
+    const __m256 clamp_hi = _mm256_set1_ps(25.0f);
+    const __m256i none = _mm256_set1_epi32(-1);
+
+    int n = begin;
+    for (; n + 8 <= end; n += 8) {
+        __m256 px = _mm256_loadu_ps(&src.x[n]);
+        __m256 py = _mm256_loadu_ps(&src.y[n]);
+        __m256 pz = _mm256_loadu_ps(&src.z[n]);
+        __m256 m = _mm256_loadu_ps(&src.mass[n]);
+        __m256 ux = _mm256_loadu_ps(&src.vx[n]);
+        __m256 uy = _mm256_loadu_ps(&src.vy[n]);
+        __m256 uz = _mm256_loadu_ps(&src.vz[n]);
+
+        __m256 Fx = _mm256_sub_ps(_mm256_mul_ps(zero, m), _mm256_mul_ps(ux, c));
+        __m256 Fy = _mm256_sub_ps(_mm256_mul_ps(gravity_y, m), _mm256_mul_ps(uy, c));
+        __m256 Fz = _mm256_sub_ps(_mm256_mul_ps(zero, m), _mm256_mul_ps(uz, c));
+
+        for (int i = 0; i < 4; i++) {
+            __m256i other = _mm256_loadu_si256((const __m256i*)&connections.slot[i][n]);
+            __m256 valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(other, none));
+            if (_mm256_movemask_ps(valid) == 0) {
+                continue;
+            }
+
+            __m256 dx = _mm256_sub_ps(_mm256_mask_i32gather_ps(zero, src.x.data(), other, valid, 4), px);
+            __m256 dy = _mm256_sub_ps(_mm256_mask_i32gather_ps(zero, src.y.data(), other, valid, 4), py);
+            __m256 dz = _mm256_sub_ps(_mm256_mask_i32gather_ps(zero, src.z.data(), other, valid, 4), pz);
+
+            __m256 x = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+            __m256 rest_length = _mm256_loadu_ps(&connections.rest_length[i][n]);
+            __m256 f = _mm256_mul_ps(neg_k, _mm256_sub_ps(rest_length, x));
+
+            Fx = _mm256_add_ps(Fx, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(dx, x), f)));
+            Fy = _mm256_add_ps(Fy, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(dy, x), f)));
+            Fz = _mm256_add_ps(Fz, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(dz, x), f)));
+        }
+
+        // Pinned nodes have an inverse mass of 0, so they never accelerate.
+        __m256 w = _mm256_loadu_ps(&connections.inv_mass[n]);
+
+        __m256 ax = _mm256_mul_ps(Fx, w);
+        __m256 ay = _mm256_mul_ps(Fy, w);
+        __m256 az = _mm256_mul_ps(Fz, w);
+
+        __m256 sx = _mm256_add_ps(_mm256_mul_ps(ux, t), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(ax, half), t), t));
+        __m256 sy = _mm256_add_ps(_mm256_mul_ps(uy, t), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(ay, half), t), t));
+        __m256 sz = _mm256_add_ps(_mm256_mul_ps(uz, t), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(az, half), t), t));
+
+        sx = _mm256_min_ps(_mm256_max_ps(sx, clamp_lo), clamp_hi);
+        sy = _mm256_min_ps(_mm256_max_ps(sy, clamp_lo), clamp_hi);
+        sz = _mm256_min_ps(_mm256_max_ps(sz, clamp_lo), clamp_hi);
+
+        _mm256_storeu_ps(&dst.x[n], _mm256_add_ps(px, sx));
+        _mm256_storeu_ps(&dst.y[n], _mm256_add_ps(py, sy));
+        _mm256_storeu_ps(&dst.z[n], _mm256_add_ps(pz, sz));
+        _mm256_storeu_ps(&dst.mass[n], m);
+        _mm256_storeu_ps(&dst.vx[n], _mm256_add_ps(ux, _mm256_mul_ps(ax, t)));
+        _mm256_storeu_ps(&dst.vy[n], _mm256_add_ps(uy, _mm256_mul_ps(ay, t)));
+        _mm256_storeu_ps(&dst.vz[n], _mm256_add_ps(uz, _mm256_mul_ps(az, t)));
+    }
+
+    spring_kernel_scalar(params, src, connections, dst, n, end);
+}
+
+// 16 nodes per iteration, using mask registers instead of blend masks.
+__attribute__((target("avx512f")))
+static void spring_kernel_avx512(
+    const SpringParams& params, const ParticleStore& src,
+    const ConnectionStore& connections, ParticleStore& dst,
+    int begin, int end) {
+
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 gravity_y = _mm512_set1_ps(GRAVITY_Y);
+    const __m512 c = _mm512_set1_ps(params.c);
+    const __m512 neg_k = _mm512_set1_ps(-params.k);
+    const __m512 t = _mm512_set1_ps(params.t);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 clamp_lo = _mm512_set1_ps(-25.0f);
+    const __m512 clamp_hi = _mm512_set1_ps(25.0f);
+    const __m512i none = _mm512_set1_epi32(-1);
+
+    int n = begin;
+    for (; n + 16 <= end; n += 16) {
+        __m512 px = _mm512_loadu_ps(&src.x[n]);
+        __m512 py = _mm512_loadu_ps(&src.y[n]);
+        __m512 pz = _mm512_loadu_ps(&src.z[n]);
+        __m512 m = _mm512_loadu_ps(&src.mass[n]);
+        __m512 ux = _mm512_loadu_ps(&src.vx[n]);
+        __m512 uy = _mm512_loadu_ps(&src.vy[n]);
+        __m512 uz = _mm512_loadu_ps(&src.vz[n]);
+
+        __m512 Fx = _mm512_sub_ps(_mm512_mul_ps(zero, m), _mm512_mul_ps(ux, c));
+        __m512 Fy = _mm512_sub_ps(_mm512_mul_ps(gravity_y, m), _mm512_mul_ps(uy, c));
+        __m512 Fz = _mm512_sub_ps(_mm512_mul_ps(zero, m), _mm512_mul_ps(uz, c));
+
+        for (int i = 0; i < 4; i++) {
+            __m512i other = _mm512_loadu_si512(&connections.slot[i][n]);
+            __mmask16 valid = _mm512_cmpgt_epi32_mask(other, none);
+            if (valid == 0) {
+                continue;
+            }
+
+            __m512 dx = _mm512_sub_ps(_mm512_mask_i32gather_ps(zero, valid, other, src.x.data(), 4), px);
+            __m512 dy = _mm512_sub_ps(_mm512_mask_i32gather_ps(zero, valid, other, src.y.data(), 4), py);
+            __m512 dz = _mm512_sub_ps(_mm512_mask_i32gather_ps(zero, valid, other, src.z.data(), 4), pz);
+
+            __m512 x = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(
+                _mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz)));
+            __m512 rest_length = _mm512_loadu_ps(&connections.rest_length[i][n]);
+            __m512 f = _mm512_mul_ps(neg_k, _mm512_sub_ps(rest_length, x));
+
+            Fx = _mm512_mask_add_ps(Fx, valid, Fx, _mm512_mul_ps(_mm512_div_ps(dx, x), f));
+            Fy = _mm512_mask_add_ps(Fy, valid, Fy, _mm512_mul_ps(_mm512_div_ps(dy, x), f));
+            Fz = _mm512_mask_add_ps(Fz, valid, Fz, _mm512_mul_ps(_mm512_div_ps(dz, x), f));
+        }
+
+        // Pinned nodes have an inverse mass of 0, so they never accelerate.
+        __m512 w = _mm512_loadu_ps(&connections.inv_mass[n]);
+
+        __m512 ax = _mm512_mul_ps(Fx, w);
+        __m512 ay = _mm512_mul_ps(Fy, w);
+        __m512 az = _mm512_mul_ps(Fz, w);
+
+        __m512 sx = _mm512_add_ps(_mm512_mul_ps(ux, t), _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(ax, half), t), t));
+        __m512 sy = _mm512_add_ps(_mm512_mul_ps(uy, t), _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(ay, half), t), t));
+        __m512 sz = _mm512_add_ps(_mm512_mul_ps(uz, t), _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(az, half), t), t));
+
+        sx = _mm512_min_ps(_mm512_max_ps(sx, clamp_lo), clamp_hi);
+        sy = _mm512_min_ps(_mm512_max_ps(sy, clamp_lo), clamp_hi);
+        sz = _mm512_min_ps(_mm512_max_ps(sz, clamp_lo), clamp_hi);
+
+        _mm512_storeu_ps(&dst.x[n], _mm512_add_ps(px, sx));
+        _mm512_storeu_ps(&dst.y[n], _mm512_add_ps(py, sy));
+        _mm512_storeu_ps(&dst.z[n], _mm512_add_ps(pz, sz));
+        _mm512_storeu_ps(&dst.mass[n], m);
+        _mm512_storeu_ps(&dst.vx[n], _mm512_add_ps(ux, _mm512_mul_ps(ax, t)));
+        _mm512_storeu_ps(&dst.vy[n], _mm512_add_ps(uy, _mm512_mul_ps(ay, t)));
+        _mm512_storeu_ps(&dst.vz[n], _mm512_add_ps(uz, _mm512_mul_ps(az, t)));
+    }
+
+    spring_kernel_scalar(params, src, connections, dst, n, end);
+}
+
+#endif
+
+SimdLevel detect_simd_level() {
+#if HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_AVX512:
+            return "avx512";
+        case SIMD_SCALAR:
+        default:
+            return "scalar";
+    }
+}
+
+SpringKernel get_spring_kernel(SimdLevel level) {
+#if HAVE_X86_KERNELS
+    switch (level) {
+        case SIMD_AVX2:
+            return spring_kernel_avx2;
+        case SIMD_AVX512:
+            return spring_kernel_avx512;
+        case SIMD_SCALAR:
+        default:
+            break;
+    }
+#endif
+    return spring_kernel_scalar;
+}
+
+SoaSpringSolver::SoaSpringSolver(int points_x, int points_y, SimdLevel level)
+    : m_points_x(points_x), m_points_y(points_y), m_iteration_index(0), m_time(0),
+      m_level(level), m_kernel(get_spring_kernel(level)),
+      m_pool(nullptr), m_rows_per_tile(0) {
+
+    int total = points_total();
+    m_particles[0].resize(total);
+    m_particles[1].resize(total);
+    m_connections.resize(total);
+
+    reset();
+}
+
+void SoaSpringSolver::reset() {
+    int total = points_total();
+    std::vector<Vec4f> positions(total);
+    std::vector<Vec3f> velocities(total);
+    std::vector<Vec4i> connections(total);
+
+    init_cloth_grid(m_points_x, m_points_y,
+        positions.data(), velocities.data(), connections.data());
+
+    SpringTopology topology;
+    std::vector<float> inv_masses;
+    build_cloth_topology(m_points_x, m_points_y, m_params, topology);
+    build_cloth_pins(m_points_x, m_points_y, m_params, m_pins);
+    compute_inverse_masses(m_pins, positions.data(), total, inv_masses);
+
+    m_particles[0].load(positions.data(), velocities.data());
+    m_particles[1].load(positions.data(), velocities.data());
+    m_connections.load(connections.data(), topology, inv_masses.data());
+    m_iteration_index = 0;
+    m_time = 0;
+}
+
+void SoaSpringSolver::move_pins(ParticleStore& particles) const {
+    for (const Pin& pin : m_pins.pins) {
+        Vec3f p = m_pins.target(pin, m_time);
+        particles.x[pin.node] = p.x;
+        particles.y[pin.node] = p.y;
+        particles.z[pin.node] = p.z;
+    }
+}
+
+void SoaSpringSolver::step() {
+    const ParticleStore& src = m_particles[m_iteration_index & 1];
+    m_iteration_index++;
+    ParticleStore& dst = m_particles[m_iteration_index & 1];
+
+    if (!m_pool) {
+        for (const NodeSpan& span : m_pins.free_spans) {
+            m_kernel(m_params, src, m_connections, dst, span.begin, span.end);
+        }
+    }
+    else {
+        int tiles = (m_points_y + m_rows_per_tile - 1) / m_rows_per_tile;
+        m_pool->parallel_for(tiles, [&](int tile) {
+            int begin = tile * m_rows_per_tile * m_points_x;
+            int end = std::min(begin + m_rows_per_tile * m_points_x, points_total());
+            m_pins.for_free_spans(begin, end, [&](int span_begin, int span_end) {
+                m_kernel(m_params, src, m_connections, dst, span_begin, span_end);
+            });
+        });
+    }
+
+    m_time += m_params.t;
+    if (m_pins.animated) {
+        move_pins(dst);
+    }
+}
+
+void SoaSpringSolver::step(int iterations) {
+    for (int i = iterations; i != 0; --i) {
+        step();
+    }
+}
+
+void SoaSpringSolver::set_thread_pool(ThreadPool* pool, int rows_per_tile) {
+    // Around 16K nodes per tile keeps a tile's three rows of positions in
+    // L2 while still giving the pool several tiles per thread to balance.
+    const int target_tile_nodes = 16384;
+
+    m_pool = pool;
+    if (rows_per_tile <= 0) {
+        rows_per_tile = std::max(target_tile_nodes / m_points_x, 1);
+    }
+    m_rows_per_tile = rows_per_tile;
+}
+
+void SoaSpringSolver::read_back(Vec4f* positions_mass, Vec3f* velocities) const {
+    m_particles[m_iteration_index & 1].store(positions_mass, velocities);
+}
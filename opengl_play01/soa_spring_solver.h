@@ -0,0 +1,84 @@
+#pragma once
+
+#include "particle_store.h"
+#include "spring_mass_solver.h"
+#include "thread_pool.h"
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+// Highest instruction set the running CPU supports.
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// Updates nodes [begin, end) of dst from src. All kernels compute the
+// same thing as update_spring_node(); the vector ones differ from the
+// scalar one only in rounding (see SOA_KERNEL_TOLERANCE).
+typedef void (*SpringKernel)(
+    const SpringParams& params, const ParticleStore& src,
+    const ConnectionStore& connections, ParticleStore& dst,
+    int begin, int end);
+
+// Returns the kernel for level, or the scalar one if the level is not
+// compiled in for this architecture.
+SpringKernel get_spring_kernel(SimdLevel level);
+
+// Largest absolute position difference allowed between a vector kernel
+// and SpringMassSolver after 64 steps of the default cloth.
+const float SOA_KERNEL_TOLERANCE = 1e-3f;
+
+// SpringMassSolver on structure-of-arrays streams, stepped with the
+// kernel for a chosen instruction set. The kernels only see the free
+// spans of pins(); nodes are numbered row-major.
+class SoaSpringSolver {
+public:
+    SoaSpringSolver(int points_x, int points_y, SimdLevel level = detect_simd_level());
+
+    void reset();
+
+    void step();
+    void step(int iterations);
+
+    // Steps the grid as row tiles on pool, one parallel_for (and so one
+    // barrier) per substep. rows_per_tile 0 picks a size automatically.
+    // Pass a null pool to go back to stepping on the calling thread.
+    void set_thread_pool(ThreadPool* pool, int rows_per_tile = 0);
+
+    // Converts the current state back into the GL buffer layout.
+    // velocities may be null.
+    void read_back(Vec4f* positions_mass, Vec3f* velocities) const;
+
+    int points_x() const { return m_points_x; }
+    int points_y() const { return m_points_y; }
+    int points_total() const { return m_points_x * m_points_y; }
+
+    SimdLevel simd_level() const { return m_level; }
+
+    unsigned iteration_index() const { return m_iteration_index; }
+
+    SpringParams& params() { return m_params; }
+    const SpringParams& params() const { return m_params; }
+
+    const PinSet& pins() const { return m_pins; }
+
+private:
+    // Writes the swaying pins' targets into particles.
+    void move_pins(ParticleStore& particles) const;
+
+    int m_points_x;
+    int m_points_y;
+    unsigned m_iteration_index;
+    double m_time;
+    SimdLevel m_level;
+    SpringKernel m_kernel;
+    SpringParams m_params;
+    ThreadPool* m_pool;
+    int m_rows_per_tile;
+
+    ParticleStore m_particles[2];
+    ConnectionStore m_connections;
+    PinSet m_pins;
+};
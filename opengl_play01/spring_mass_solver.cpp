@@ -0,0 +1,149 @@
+#include "spring_mass_solver.h"
+
+#include <algorithm>
+
+static const Vec3f gravity(0.0f, GRAVITY_Y, 0.0f);
+
+Vec4f cloth_grid_position(int points_x, int points_y, int i, int j) {
+    float fi = (float)i / (float)points_x;
+    float fj = (float)j / (float)points_y;
+
+    return Vec4f((fi - 0.5f) * (float)points_x,
+                 (fj - 0.5f) * (float)points_y,
+                 0.6f * sinf(fi) * cosf(fj),
+                 1.0f);
+}
+
+void init_cloth_grid(
+    int points_x, int points_y,
+    Vec4f* positions, Vec3f* velocities, Vec4i* connections) {
+
+    int i, j;
+    int n = 0;
+
+    for (j = 0; j < points_y; j++) {
+        for (i = 0; i < points_x; i++) {
+            positions[n] = cloth_grid_position(points_x, points_y, i, j);
+            velocities[n] = Vec3f(0, 0, 0);
+
+            if (connections) {
+                connections[n] = Vec4i(-1, -1, -1, -1);
+
+                if (i != 0)
+                    connections[n][0] = n - 1;
+
+                if (j != 0)
+                    connections[n][1] = n - points_x;
+
+                if (i != (points_x - 1))
+                    connections[n][2] = n + 1;
+
+                if (j != (points_y - 1))
+                    connections[n][3] = n + points_x;
+            }
+            n++;
+        }
+    }
+}
+
+void compute_inverse_masses(const PinSet& pins, const Vec4f* positions_mass, int count,
+    std::vector<float>& inv_masses) {
+
+    inv_masses.resize(count);
+    for (int n = 0; n < count; n++) {
+        inv_masses[n] = 1.0f / positions_mass[n].w;
+    }
+    for (const Pin& pin : pins.pins) {
+        inv_masses[pin.node] = 0.0f;
+    }
+}
+
+void update_spring_node(
+    const SpringParams& params, const SpringTopology& topology, const float* inv_masses,
+    const Vec4f* positions,
+    int node, const Vec4f& position_mass, const Vec3f& velocity,
+    Vec4f& out_position_mass, Vec3f& out_velocity) {
+
+    Vec3f p(position_mass.x, position_mass.y, position_mass.z);
+    float m = position_mass.w;
+    Vec3f u = velocity;
+    Vec3f F = gravity * m - u * params.c;
+    int begin = topology.offsets[node];
+    int end = topology.offsets[node + 1];
+
+    for (int s = begin; s < end; s++) {
+        const Vec4f& other = positions[topology.neighbours[s]];
+        const SpringCoeffs& spring = topology.coeffs[s];
+        Vec3f d = Vec3f(other.x, other.y, other.z) - p;
+        float x = d.length();
+        F += (d / x) * (-spring.stiffness * (spring.rest_length - x));
+    }
+
+    float t = params.t;
+    Vec3f a = F * inv_masses[node];
+    Vec3f s = u * t + a * 0.5f * t * t;
+    Vec3f v = u + a * t;
+
+    s.x = std::min(std::max(s.x, -25.0f), 25.0f);
+    s.y = std::min(std::max(s.y, -25.0f), 25.0f);
+    s.z = std::min(std::max(s.z, -25.0f), 25.0f);
+
+    out_position_mass = Vec4f(p.x + s.x, p.y + s.y, p.z + s.z, m);
+    out_velocity = v;
+}
+
+SpringMassSolver::SpringMassSolver(int points_x, int points_y, NodeOrder order)
+    : m_points_x(points_x), m_points_y(points_y), m_iteration_index(0), m_time(0) {
+
+    build_node_order(points_x, points_y, order, m_permutation);
+
+    int total = points_total();
+    for (int i = 0; i < 2; i++) {
+        m_positions[i].resize(total);
+        m_velocities[i].resize(total);
+    }
+
+    reset();
+}
+
+void SpringMassSolver::reset() {
+    init_cloth_grid(m_points_x, m_points_y,
+        m_positions[0].data(), m_velocities[0].data(), nullptr);
+    build_cloth_topology(m_points_x, m_points_y, m_params, m_topology);
+    permute_nodes(m_permutation, m_positions[0].data(), m_velocities[0].data());
+    permute_topology(m_permutation, m_topology);
+    build_cloth_pins(m_points_x, m_points_y, m_params, m_pins);
+    permute_pins(m_permutation, m_pins);
+    compute_inverse_masses(m_pins, m_positions[0].data(), points_total(), m_inv_masses);
+    m_positions[1] = m_positions[0];
+    m_velocities[1] = m_velocities[0];
+    m_iteration_index = 0;
+    m_time = 0;
+}
+
+void SpringMassSolver::step() {
+    const Vec4f* src_pos = m_positions[m_iteration_index & 1].data();
+    const Vec3f* src_vel = m_velocities[m_iteration_index & 1].data();
+    m_iteration_index++;
+    Vec4f* dst_pos = m_positions[m_iteration_index & 1].data();
+    Vec3f* dst_vel = m_velocities[m_iteration_index & 1].data();
+
+    for (const NodeSpan& span : m_pins.free_spans) {
+        for (int n = span.begin; n < span.end; n++) {
+            update_spring_node(m_params, m_topology, m_inv_masses.data(), src_pos,
+                n, src_pos[n], src_vel[n],
+                dst_pos[n], dst_vel[n]);
+        }
+    }
+
+    m_time += m_params.t;
+    if (m_pins.animated) {
+        m_pins.move(m_time, dst_pos);
+    }
+}
+
+void SpringMassSolver::step(int iterations) {
+    for (int i = iterations; i != 0; --i) {
+        step();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+
+#include <vector>
+
+#include "node_ordering.h"
+#include "pin_set.h"
+#include "spring_topology.h"
+#include "vec_stuff.h"
+
+// The gravity constant from update.vs.glsl (it only acts along y).
+const float GRAVITY_Y = -0.08f;
+
+// Same defaults as the uniforms in shaders/springmass/update.vs.glsl. k
+// and rest_length are what build_cloth_topology() gives the axial
+// springs; k_shear and k_bend, when non-zero, add diagonal and skip-one
+// springs with that stiffness. pins and pin_sway are what
+// build_cloth_pins() holds the cloth by.
+struct SpringParams {
+    float t;
+    float k;
+    float c;
+    float rest_length;
+    float k_shear;
+    float k_bend;
+    PinLayout pins;
+    float pin_sway;
+
+    SpringParams()
+        : t(0.07f), k(7.1f), c(2.8f), rest_length(0.88f), k_shear(0.0f), k_bend(0.0f),
+          pins(PINS_TOP_ROW), pin_sway(0.0f) {
+    }
+};
+
+// Where init_cloth_grid() puts node (i, j), mass in w.
+Vec4f cloth_grid_position(int points_x, int points_y, int i, int j);
+
+// Fills the arrays (each points_x * points_y long) with the initial cloth
+// used by startup(): a sheet of unit masses at rest, 4-connected. What
+// holds it up is build_cloth_pins()'s business. connections may be null
+// when only build_cloth_topology()'s springs are wanted.
+void init_cloth_grid(
+    int points_x, int points_y,
+    Vec4f* positions, Vec3f* velocities, Vec4i* connections);
+
+// Fills inv_masses (count long) with the per-node stream startup()
+// uploads next to the spring graph: 1 / mass, or 0 for a pinned node, so
+// the springs pulling on it never move it.
+void compute_inverse_masses(const PinSet& pins, const Vec4f* positions_mass, int count,
+    std::vector<float>& inv_masses);
+
+// CPU version of the transform-feedback update pass. The host buffers are
+// laid out exactly like m_vbo[POSITION_*] (xyz + mass) and
+// m_vbo[VELOCITY_*] (packed xyz), and are ping-ponged the same way
+// render() ping-pongs the two VAOs. The springs come from the same
+// SpringTopology startup() uploads, and the nodes are numbered in order.
+// Only the free spans of pins() are stepped.
+class SpringMassSolver {
+public:
+    SpringMassSolver(int points_x, int points_y, NodeOrder order = ORDER_ROW_MAJOR);
+
+    void reset();
+
+    void step();
+    void step(int iterations);
+
+    int points_x() const { return m_points_x; }
+    int points_y() const { return m_points_y; }
+    int points_total() const { return m_points_x * m_points_y; }
+
+    unsigned iteration_index() const { return m_iteration_index; }
+
+    SpringParams& params() { return m_params; }
+    const SpringParams& params() const { return m_params; }
+
+    const Vec4f* positions() const { return m_positions[m_iteration_index & 1].data(); }
+    const Vec3f* velocities() const { return m_velocities[m_iteration_index & 1].data(); }
+    SpringTopology& topology() { return m_topology; }
+    const SpringTopology& topology() const { return m_topology; }
+    const NodePermutation& permutation() const { return m_permutation; }
+    // In the solver's node order.
+    const PinSet& pins() const { return m_pins; }
+    const float* inv_masses() const { return m_inv_masses.data(); }
+
+private:
+    int m_points_x;
+    int m_points_y;
+    unsigned m_iteration_index;
+    // Simulated time since reset(), which swaying pins follow.
+    double m_time;
+    SpringParams m_params;
+
+    std::vector<Vec4f> m_positions[2];
+    std::vector<Vec3f> m_velocities[2];
+    SpringTopology m_topology;
+    PinSet m_pins;
+    std::vector<float> m_inv_masses;
+    NodePermutation m_permutation;
+};
+
+// Per-node body of update.vs.glsl for node, reading neighbours from
+// positions. Only t and c are taken from params; the springs carry their
+// own rest length and stiffness.
+void update_spring_node(
+    const SpringParams& params, const SpringTopology& topology, const float* inv_masses,
+    const Vec4f* positions,
+    int node, const Vec4f& position_mass, const Vec3f& velocity,
+    Vec4f& out_position_mass, Vec3f& out_velocity);
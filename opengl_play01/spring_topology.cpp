@@ -0,0 +1,195 @@
+#include "spring_topology.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spring_mass_solver.h"
+
+void SpringTopology::clear() {
+    offsets.assign(1, 0);
+    neighbours.clear();
+    coeffs.clear();
+}
+
+void SpringTopology::add_spring(int neighbour, float rest_length, float stiffness) {
+    SpringCoeffs spring;
+    spring.rest_length = rest_length;
+    spring.stiffness = stiffness;
+
+    neighbours.push_back(neighbour);
+    coeffs.push_back(spring);
+}
+
+void SpringTopology::finish_node() {
+    offsets.push_back((int)neighbours.size());
+}
+
+void SpringTopology::from_connections(const Vec4i* connections, int node_count,
+    float rest_length, float stiffness) {
+
+    clear();
+    neighbours.reserve((size_t)node_count * 4);
+    coeffs.reserve((size_t)node_count * 4);
+
+    for (int n = 0; n < node_count; n++) {
+        for (int i = 0; i < 4; i++) {
+            if (connections[n][i] != -1) {
+                add_spring(connections[n][i], rest_length, stiffness);
+            }
+        }
+        finish_node();
+    }
+}
+
+int SpringTopology::find_spring(int from, int to) const {
+    for (int s = offsets[from]; s < offsets[from + 1]; s++) {
+        if (neighbours[s] == to) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+bool SpringTopology::is_valid() const {
+    if (offsets.empty() || offsets[0] != 0 || offsets.back() != springs() ||
+        coeffs.size() != neighbours.size()) {
+        return false;
+    }
+
+    int count = nodes();
+    for (int n = 0; n < count; n++) {
+        if (offsets[n + 1] < offsets[n]) {
+            return false;
+        }
+    }
+    for (int neighbour : neighbours) {
+        if (neighbour < 0 || neighbour >= count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SpringTopology::line_indices(std::vector<int>& lines) const {
+    lines.clear();
+    lines.reserve(neighbours.size());
+
+    int count = nodes();
+    for (int n = 0; n < count; n++) {
+        for (int s = offsets[n]; s < offsets[n + 1]; s++) {
+            int other = neighbours[s];
+            if (n < other || !has_spring(other, n)) {
+                lines.push_back(n);
+                lines.push_back(other);
+            }
+        }
+    }
+}
+
+void build_cloth_topology(int points_x, int points_y, const SpringParams& params,
+    SpringTopology& topology) {
+
+    const float r = params.rest_length;
+    const float k = params.k;
+    const bool shear = params.k_shear != 0.0f;
+    const bool bend = params.k_bend != 0.0f;
+
+    int per_node = 4 + (shear ? 4 : 0) + (bend ? 4 : 0);
+    topology.clear();
+    topology.neighbours.reserve((size_t)points_x * points_y * per_node);
+    topology.coeffs.reserve((size_t)points_x * points_y * per_node);
+
+    // Extra springs as grid offsets, in increasing index order.
+    struct Extra { int di, dj; float rest_length, stiffness; };
+    const float diagonal = r * sqrtf(2.0f);
+    const Extra extras[] = {
+        {  0, -2, 2.0f * r, params.k_bend },
+        { -1, -1, diagonal, params.k_shear },
+        {  1, -1, diagonal, params.k_shear },
+        { -2,  0, 2.0f * r, params.k_bend },
+        {  2,  0, 2.0f * r, params.k_bend },
+        { -1,  1, diagonal, params.k_shear },
+        {  1,  1, diagonal, params.k_shear },
+        {  0,  2, 2.0f * r, params.k_bend },
+    };
+
+    int n = 0;
+
+    for (int j = 0; j < points_y; j++) {
+        for (int i = 0; i < points_x; i++) {
+            if (i != 0)
+                topology.add_spring(n - 1, r, k);
+
+            if (j != 0)
+                topology.add_spring(n - points_x, r, k);
+
+            if (i != points_x - 1)
+                topology.add_spring(n + 1, r, k);
+
+            if (j != points_y - 1)
+                topology.add_spring(n + points_x, r, k);
+
+            if (shear || bend) {
+                for (const Extra& extra : extras) {
+                    int ei = i + extra.di;
+                    int ej = j + extra.dj;
+                    if (extra.stiffness != 0.0f &&
+                        ei >= 0 && ei < points_x && ej >= 0 && ej < points_y) {
+                        topology.add_spring(ei + ej * points_x, extra.rest_length, extra.stiffness);
+                    }
+                }
+            }
+            topology.finish_node();
+            n++;
+        }
+    }
+}
+
+int color_nodes(const SpringTopology& topology, std::vector<int>& colors) {
+    int nodes = topology.nodes();
+
+    // Springs pointing at each node, so both directions get checked
+    std::vector<int> in_offsets(nodes + 1, 0);
+    for (int neighbour : topology.neighbours) {
+        in_offsets[neighbour + 1]++;
+    }
+    for (int n = 0; n < nodes; n++) {
+        in_offsets[n + 1] += in_offsets[n];
+    }
+    std::vector<int> in_neighbours(topology.springs());
+    std::vector<int> next(in_offsets.begin(), in_offsets.end() - 1);
+    for (int n = 0; n < nodes; n++) {
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            in_neighbours[next[topology.neighbours[s]]++] = n;
+        }
+    }
+
+    colors.assign(nodes, -1);
+    int color_count = 0;
+    std::vector<bool> taken;
+
+    for (int n = 0; n < nodes; n++) {
+        taken.assign(color_count + 1, false);
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            int color = colors[topology.neighbours[s]];
+            if (color >= 0) {
+                taken[color] = true;
+            }
+        }
+        for (int s = in_offsets[n]; s < in_offsets[n + 1]; s++) {
+            int color = colors[in_neighbours[s]];
+            if (color >= 0) {
+                taken[color] = true;
+            }
+        }
+
+        int color = 0;
+        while (taken[color]) {
+            color++;
+        }
+        colors[n] = color;
+        color_count = std::max(color_count, color + 1);
+    }
+
+    return color_count;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+
+#include <vector>
+
+#include "vec_stuff.h"
+
+struct SpringParams;
+
+// Per-spring constants, interleaved so the shader gets both with one
+// RG32F texelFetch.
+struct SpringCoeffs {
+    float rest_length;
+    float stiffness;
+};
+
+// Spring graph in compressed sparse row form. The springs acting on node
+// n are neighbours[offsets[n] .. offsets[n + 1]), each with its own rest
+// length and stiffness in coeffs[]. Springs are directed: node a pulling
+// on b doesn't imply b pulls on a. Which nodes are held in place is up to
+// a PinSet, not the graph.
+struct SpringTopology {
+    std::vector<int> offsets;
+    std::vector<int> neighbours;
+    std::vector<SpringCoeffs> coeffs;
+
+    int nodes() const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+    int springs() const { return (int)neighbours.size(); }
+
+    int degree(int node) const { return offsets[node + 1] - offsets[node]; }
+
+    // Empties the graph. It is then built one node at a time, in order:
+    // add_spring() for each of the node's springs, then finish_node().
+    void clear();
+    void add_spring(int neighbour, float rest_length, float stiffness);
+    void finish_node();
+
+    // Same springs as an ivec4 connection array (-1 = no spring).
+    void from_connections(const Vec4i* connections, int node_count,
+        float rest_length, float stiffness);
+
+    bool has_spring(int from, int to) const { return find_spring(from, to) >= 0; }
+    // Index of the spring from -> to, or -1.
+    int find_spring(int from, int to) const;
+
+    // Checks offsets and neighbour indices are in range.
+    bool is_valid() const;
+
+    // Fills lines with a GL_LINES index pair per connected node pair,
+    // drawing springs that go both ways only once.
+    void line_indices(std::vector<int>& lines) const;
+};
+
+// Greedy node colouring: no spring, in either direction, joins two nodes
+// of one colour, so a colour's nodes can be updated in place in parallel.
+// Numbered row-major, the 4-connected grid comes out as the red-black
+// checkerboard. Returns the number of colours.
+int color_nodes(const SpringTopology& topology, std::vector<int>& colors);
+
+// The cloth from init_cloth_grid() as a spring graph. Each node lists its
+// axial springs first, in the same order as the connection slots, then
+// its shear (diagonal) and bend (two apart) springs sorted by neighbour
+// index, so the extra fetches walk memory in one direction. Every node
+// gets its springs, pinned or not.
+void build_cloth_topology(int points_x, int points_y, const SpringParams& params,
+    SpringTopology& topology);
@@ -0,0 +1,136 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int thread_count)
+    : m_thread_count(std::max(thread_count, 1)),
+      m_ranges(new TaskRange[std::max(thread_count, 1)]),
+      m_func(nullptr), m_generation(0), m_busy(0), m_quit(false) {
+
+    for (int i = 0; i < m_thread_count; i++) {
+        m_ranges[i].begin = 0;
+        m_ranges[i].end = 0;
+    }
+
+    for (int i = 1; i < m_thread_count; i++) {
+        m_threads.push_back(std::thread(&ThreadPool::worker_main, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_start_cv.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool::hardware_threads() {
+    return std::max((int)std::thread::hardware_concurrency(), 1);
+}
+
+void ThreadPool::parallel_for(int task_count, const std::function<void(int)>& func) {
+    if (task_count <= 0) {
+        return;
+    }
+
+    if (m_thread_count == 1 || task_count == 1) {
+        for (int task = 0; task < task_count; task++) {
+            func(task);
+        }
+        return;
+    }
+
+    // Workers are idle between calls; the generation bump below wakes them.
+    for (int i = 0; i < m_thread_count; i++) {
+        std::lock_guard<std::mutex> lock(m_ranges[i].mutex);
+        m_ranges[i].begin = (int)((long long)task_count * i / m_thread_count);
+        m_ranges[i].end = (int)((long long)task_count * (i + 1) / m_thread_count);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_busy = m_thread_count - 1;
+        m_generation++;
+    }
+    m_start_cv.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_busy == 0; });
+    m_func = nullptr;
+}
+
+void ThreadPool::worker_main(int index) {
+    unsigned seen_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start_cv.wait(lock, [&] { return m_quit || m_generation != seen_generation; });
+            if (m_quit) {
+                return;
+            }
+            seen_generation = m_generation;
+        }
+
+        run_tasks(index);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy--;
+        }
+        m_done_cv.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks(int index) {
+    const std::function<void(int)>& func = *m_func;
+    int task;
+
+    do {
+        while (pop_task(index, task)) {
+            func(task);
+        }
+    } while (steal_tasks(index));
+}
+
+bool ThreadPool::pop_task(int index, int& task) {
+    TaskRange& range = m_ranges[index];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin >= range.end) {
+        return false;
+    }
+    task = range.begin++;
+    return true;
+}
+
+bool ThreadPool::steal_tasks(int index) {
+    for (int i = 1; i < m_thread_count; i++) {
+        TaskRange& victim = m_ranges[(index + i) % m_thread_count];
+        int begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            int remaining = victim.end - victim.begin;
+            if (remaining <= 0) {
+                continue;
+            }
+            end = victim.end;
+            begin = victim.end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+
+        TaskRange& own = m_ranges[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork/join pool for data-parallel loops. parallel_for() hands every
+// thread a contiguous share of the task range; a thread that runs out
+// steals the back half of another thread's remaining share, so uneven
+// tiles even out without a central queue. The calling thread takes part
+// as thread 0, and parallel_for() only returns once every task has run,
+// which makes each call a full barrier.
+class ThreadPool {
+public:
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int thread_count() const { return m_thread_count; }
+
+    void parallel_for(int task_count, const std::function<void(int)>& func);
+
+    // Number of hardware threads, at least 1.
+    static int hardware_threads();
+
+private:
+    struct TaskRange {
+        std::mutex mutex;
+        int begin;
+        int end;
+    };
+
+    void worker_main(int index);
+    void run_tasks(int index);
+    bool pop_task(int index, int& task);
+    bool steal_tasks(int index);
+
+    int m_thread_count;
+    std::vector<std::thread> m_threads;
+    std::unique_ptr<TaskRange[]> m_ranges;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(int)>* m_func;
+    unsigned m_generation;
+    int m_busy;
+    bool m_quit;
+};
@@ -0,0 +1,483 @@
+#include "trajectory_recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Residuals are kept well inside int32 so the zigzag varint never needs
+// more than 5 bytes; anything larger is written as a keyframe instead.
+static const float MAX_RESIDUAL = 1073741824.0f;
+
+// Components per encoding task. Each task writes its own varint run and
+// the runs are concatenated, so the payload doesn't depend on the split.
+static const size_t ENCODE_BLOCK = 65536;
+
+// Large stdio buffer so chunk writes reach the disk in big requests.
+static const size_t TRAJECTORY_FILE_BUFFER = 4 << 20;
+
+static uint8_t* put_varint(uint8_t* out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+void TrajectoryCodec::reset(uint32_t points, float error_bound) {
+    m_points = points;
+    m_step = 2.0f * error_bound;
+    m_history = 0;
+    m_recon[0].assign((size_t)points * 3, 0.0f);
+    m_recon[1].assign((size_t)points * 3, 0.0f);
+    m_next.assign((size_t)points * 3, 0.0f);
+}
+
+void TrajectoryCodec::push_reconstruction() {
+    m_recon[1].swap(m_recon[0]);
+    m_recon[0].swap(m_next);
+    m_history = std::min(m_history + 1, 2);
+}
+
+bool TrajectoryCodec::encode_block(const float* xyz, size_t begin, size_t end, std::vector<uint8_t>& out) {
+    const float* last = m_recon[0].data();
+    const float* before = m_recon[1].data();
+    float* next = m_next.data();
+    float inv_step = 1.0f / m_step;
+    bool linear = (m_history >= 2);
+
+    out.resize((end - begin) * 5);
+    uint8_t* p = out.data();
+
+    for (size_t i = begin; i < end; i++) {
+        float prediction = linear ? 2.0f * last[i] - before[i] : last[i];
+
+        float residual = (xyz[i] - prediction) * inv_step;
+        if (!(fabsf(residual) < MAX_RESIDUAL)) {
+            return false;
+        }
+
+        int32_t q = (int32_t)lrintf(residual);
+        next[i] = prediction + (float)q * m_step;
+        p = put_varint(p, zigzag(q));
+    }
+
+    out.resize(p - out.data());
+    return true;
+}
+
+TrajectoryChunkType TrajectoryCodec::encode(const float* xyz, bool keyframe,
+    std::vector<uint8_t>& payload, ThreadPool* pool) {
+
+    size_t count = (size_t)m_points * 3;
+    payload.clear();
+
+    if (!keyframe && m_history > 0 && m_step > 0) {
+        int blocks = (int)((count + ENCODE_BLOCK - 1) / ENCODE_BLOCK);
+        m_blocks.resize(blocks);
+        std::vector<char> fits(blocks, 0);
+
+        auto encode_one = [&](int block) {
+            size_t begin = (size_t)block * ENCODE_BLOCK;
+            size_t end = std::min(begin + ENCODE_BLOCK, count);
+            fits[block] = encode_block(xyz, begin, end, m_blocks[block]);
+        };
+
+        if (pool) {
+            pool->parallel_for(blocks, encode_one);
+        }
+        else {
+            for (int block = 0; block < blocks; block++) {
+                encode_one(block);
+            }
+        }
+
+        if (std::find(fits.begin(), fits.end(), 0) == fits.end()) {
+            for (const std::vector<uint8_t>& block : m_blocks) {
+                payload.insert(payload.end(), block.begin(), block.end());
+            }
+            push_reconstruction();
+            return TRAJECTORY_DELTA;
+        }
+        payload.clear();
+    }
+
+    payload.resize(count * sizeof(float));
+    memcpy(payload.data(), xyz, count * sizeof(float));
+    memcpy(m_next.data(), xyz, count * sizeof(float));
+    m_history = 0;
+    push_reconstruction();
+    return TRAJECTORY_KEYFRAME;
+}
+
+bool TrajectoryCodec::decode(TrajectoryChunkType type, const uint8_t* payload, size_t bytes, float* xyz) {
+    size_t count = (size_t)m_points * 3;
+
+    if (type == TRAJECTORY_KEYFRAME) {
+        if (bytes != count * sizeof(float)) {
+            return false;
+        }
+        memcpy(m_next.data(), payload, bytes);
+        m_history = 0;
+    }
+    else if (type == TRAJECTORY_DELTA && m_history > 0) {
+        const uint8_t* p = payload;
+        const uint8_t* end = payload + bytes;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t value;
+            if (!get_varint(p, end, value)) {
+                return false;
+            }
+            float prediction = (m_history >= 2) ? 2.0f * m_recon[0][i] - m_recon[1][i] : m_recon[0][i];
+            m_next[i] = prediction + (float)unzigzag(value) * m_step;
+        }
+    }
+    else {
+        return false;
+    }
+
+    push_reconstruction();
+    memcpy(xyz, m_recon[0].data(), count * sizeof(float));
+    return true;
+}
+
+TrajectoryRecorder::TrajectoryRecorder()
+    : m_file(nullptr), m_filling(-1), m_quit(false), m_write_failed(false),
+      m_offset(0), m_next_frame(0), m_frames_written(0), m_frames_dropped(0), m_bytes_written(0) {
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    close();
+}
+
+bool TrajectoryRecorder::open(const char* path, int points, float error_bound,
+    int keyframe_interval, int queue_frames) {
+
+    close();
+
+    m_file = fopen(path, "wb");
+    if (!m_file) {
+        std::cout << "couldn't open " << path << " for writing" << std::endl;
+        return false;
+    }
+    setvbuf(m_file, nullptr, _IOFBF, TRAJECTORY_FILE_BUFFER);
+
+    memcpy(m_header.magic, TRAJECTORY_MAGIC, sizeof(m_header.magic));
+    m_header.version = TRAJECTORY_VERSION;
+    m_header.header_size = sizeof(m_header);
+    m_header.points = points;
+    m_header.keyframe_interval = std::max(keyframe_interval, 1);
+    m_header.error_bound = error_bound;
+    if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1) {
+        std::cout << "couldn't write to " << path << std::endl;
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_offset = sizeof(m_header);
+    m_next_frame = 0;
+
+    m_codec.reset(points, error_bound);
+    m_xyz.resize((size_t)points * 3);
+    m_index.clear();
+
+    m_slots.resize(std::max(queue_frames, 1));
+    m_slot_frames.assign(m_slots.size(), 0);
+    m_free_slots.clear();
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        m_slots[i].resize(points);
+        m_free_slots.push_back((int)i);
+    }
+    m_queued.clear();
+    m_filling = -1;
+    m_quit = false;
+    m_write_failed = false;
+    m_frames_written = 0;
+    m_frames_dropped = 0;
+    m_bytes_written = m_offset;
+
+    // The writer thread itself is one of the encoding threads.
+    m_pool.reset(new ThreadPool(ThreadPool::hardware_threads()));
+
+    m_writer = std::thread(&TrajectoryRecorder::writer_main, this);
+    return true;
+}
+
+bool TrajectoryRecorder::close() {
+    if (!m_file) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_one();
+    m_writer.join();
+    m_pool.reset();
+
+    TrajectoryFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.index_offset = m_offset;
+    footer.keyframe_count = (uint32_t)m_index.size();
+    footer.frame_count = m_frames_written ? m_next_frame : 0;
+    memcpy(footer.magic, TRAJECTORY_MAGIC, sizeof(footer.magic));
+
+    // Without the footer a reader rejects the file rather than trusting
+    // an index to chunks that never made it to disk.
+    bool ok = !m_write_failed &&
+        (m_index.empty() ||
+         fwrite(m_index.data(), sizeof(TrajectoryIndexEntry), m_index.size(), m_file) == m_index.size()) &&
+        fwrite(&footer, sizeof(footer), 1, m_file) == 1;
+    ok = (fclose(m_file) == 0) && ok;
+    m_file = nullptr;
+
+    if (!ok) {
+        std::cout << "error writing the trajectory file; recording stopped after " <<
+            m_frames_written << " frames and the file is incomplete" << std::endl;
+    }
+    return ok;
+}
+
+Vec4f* TrajectoryRecorder::begin_frame(uint32_t frame) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_write_failed) {
+        return nullptr;
+    }
+    if (m_free_slots.empty()) {
+        m_frames_dropped++;
+        return nullptr;
+    }
+    m_filling = m_free_slots.back();
+    m_free_slots.pop_back();
+    m_slot_frames[m_filling] = frame;
+    return m_slots[m_filling].data();
+}
+
+void TrajectoryRecorder::end_frame() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_filling < 0) {
+            return;
+        }
+        m_queued.push_back(m_filling);
+        m_filling = -1;
+    }
+    m_cv.notify_one();
+}
+
+uint32_t TrajectoryRecorder::frames_written() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames_written;
+}
+
+uint32_t TrajectoryRecorder::frames_dropped() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames_dropped;
+}
+
+uint64_t TrajectoryRecorder::bytes_written() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes_written;
+}
+
+void TrajectoryRecorder::writer_main() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_cv.wait(lock, [this] { return m_quit || !m_queued.empty(); });
+        if (m_queued.empty()) {
+            return;
+        }
+
+        int slot = m_queued.front();
+        m_queued.pop_front();
+
+        // Once a write fails the rest of the queue is discarded.
+        bool failed = m_write_failed;
+        lock.unlock();
+        if (!failed) {
+            failed = !write_frame(m_slots[slot].data(), m_slot_frames[slot]);
+        }
+        lock.lock();
+
+        m_write_failed = failed;
+        m_free_slots.push_back(slot);
+    }
+}
+
+bool TrajectoryRecorder::write_frame(const Vec4f* positions, uint32_t frame) {
+    uint32_t points = m_header.points;
+    const int* to_grid = m_permutation.is_identity() ? nullptr : m_permutation.to_grid.data();
+    for (uint32_t n = 0; n < points; n++) {
+        uint32_t grid = to_grid ? (uint32_t)to_grid[n] : n;
+        m_xyz[grid * 3 + 0] = positions[n].x;
+        m_xyz[grid * 3 + 1] = positions[n].y;
+        m_xyz[grid * 3 + 2] = positions[n].z;
+    }
+
+    // Keyframes are spaced by frames written, so dropped frames don't
+    // skip one.
+    uint32_t written;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        written = m_frames_written;
+    }
+    assert(written == 0 || frame >= m_next_frame);
+
+    bool keyframe = (written % m_header.keyframe_interval == 0);
+    TrajectoryChunkType type = m_codec.encode(m_xyz.data(), keyframe, m_payload, m_pool.get());
+
+    TrajectoryChunkHeader chunk;
+    chunk.type = type;
+    chunk.frame = frame;
+    chunk.payload_bytes = m_payload.size();
+    if (fwrite(&chunk, sizeof(chunk), 1, m_file) != 1 ||
+        fwrite(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size()) {
+        return false;
+    }
+
+    if (type == TRAJECTORY_KEYFRAME) {
+        TrajectoryIndexEntry entry;
+        entry.frame = frame;
+        entry.reserved = 0;
+        entry.offset = m_offset;
+        m_index.push_back(entry);
+    }
+    m_offset += sizeof(chunk) + m_payload.size();
+    m_next_frame = frame + 1;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames_written++;
+    m_bytes_written = m_offset;
+    return true;
+}
+
+TrajectoryReader::TrajectoryReader()
+    : m_file(nullptr), m_next_frame(0) {
+    memset(&m_header, 0, sizeof(m_header));
+    memset(&m_footer, 0, sizeof(m_footer));
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+bool TrajectoryReader::open(const char* path) {
+    close();
+
+    m_file = fopen(path, "rb");
+    if (!m_file) {
+        std::cout << "couldn't open trajectory " << path << std::endl;
+        return false;
+    }
+
+    bool ok = fread(&m_header, sizeof(m_header), 1, m_file) == 1 &&
+        memcmp(m_header.magic, TRAJECTORY_MAGIC, sizeof(m_header.magic)) == 0 &&
+        m_header.version == TRAJECTORY_VERSION &&
+        m_header.header_size == sizeof(m_header) &&
+        fseeko(m_file, -(off_t)sizeof(m_footer), SEEK_END) == 0 &&
+        fread(&m_footer, sizeof(m_footer), 1, m_file) == 1 &&
+        memcmp(m_footer.magic, TRAJECTORY_MAGIC, sizeof(m_footer.magic)) == 0;
+
+    if (ok) {
+        m_index.resize(m_footer.keyframe_count);
+        ok = fseeko(m_file, (off_t)m_footer.index_offset, SEEK_SET) == 0 &&
+            (m_index.empty() ||
+             fread(m_index.data(), sizeof(TrajectoryIndexEntry), m_index.size(), m_file) == m_index.size());
+    }
+
+    if (!ok) {
+        std::cout << path << " is not a complete trajectory file" << std::endl;
+        close();
+        return false;
+    }
+
+    m_codec.reset(m_header.points, m_header.error_bound);
+    m_next_frame = m_footer.frame_count;
+    return true;
+}
+
+void TrajectoryReader::close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool TrajectoryReader::read_next_chunk(float* xyz) {
+    TrajectoryChunkHeader chunk;
+    size_t max_payload = (size_t)m_header.points * 3 * 5;
+
+    if (fread(&chunk, sizeof(chunk), 1, m_file) != 1 || chunk.frame < m_next_frame ||
+        chunk.frame >= m_footer.frame_count || chunk.payload_bytes > max_payload) {
+        return false;
+    }
+
+    m_payload.resize(chunk.payload_bytes);
+    if (fread(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size()) {
+        return false;
+    }
+
+    if (!m_codec.decode((TrajectoryChunkType)chunk.type, m_payload.data(), m_payload.size(), xyz)) {
+        return false;
+    }
+
+    m_next_frame = chunk.frame + 1;
+    return true;
+}
+
+bool TrajectoryReader::read_frame(uint32_t frame, float* xyz) {
+    if (!m_file || frame >= m_footer.frame_count || m_index.empty()) {
+        return false;
+    }
+
+    // Last keyframe at or before frame.
+    auto key = std::upper_bound(m_index.begin(), m_index.end(), frame,
+        [](uint32_t f, const TrajectoryIndexEntry& entry) { return f < entry.frame; });
+    if (key == m_index.begin()) {
+        return false;
+    }
+    --key;
+
+    // Carry on from where the last read stopped if that is on the way.
+    if (m_next_frame <= key->frame || m_next_frame > frame) {
+        if (fseeko(m_file, (off_t)key->offset, SEEK_SET) != 0) {
+            return false;
+        }
+        m_next_frame = key->frame;
+    }
+
+    while (m_next_frame <= frame) {
+        if (!read_next_chunk(xyz)) {
+            m_next_frame = m_footer.frame_count;
+            return false;
+        }
+    }
+    // Landing past frame means it was dropped.
+    return m_next_frame == frame + 1;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "node_ordering.h"
+#include "thread_pool.h"
+#include "vec_stuff.h"
+
+// Trajectory file layout:
+//
+//   TrajectoryFileHeader
+//   chunk*               TrajectoryChunkHeader + payload, one per frame
+//   keyframe index       TrajectoryIndexEntry[keyframe_count]
+//   TrajectoryFooter
+//
+// A keyframe payload is the raw xyz floats of every point. A delta payload
+// holds, for each of the 3 * points components, the zigzag varint of
+// round((p - prediction) / (2 * error_bound)). The prediction extrapolates
+// linearly from the two previous reconstructed frames (or repeats the
+// previous one right after a keyframe), and both writer and reader predict
+// from reconstructed values, so errors never accumulate: every decoded
+// component is within error_bound of the recorded one, plus float rounding.
+//
+// Chunks carry the frame number they were recorded at, so frames the
+// recorder dropped leave gaps rather than shifting the later ones.
+const char TRAJECTORY_MAGIC[8] = { 'S', 'P', 'R', 'M', 'T', 'R', 'A', 'J' };
+const uint32_t TRAJECTORY_VERSION = 2;
+
+enum TrajectoryChunkType {
+    TRAJECTORY_KEYFRAME = 1,
+    TRAJECTORY_DELTA = 2
+};
+
+struct TrajectoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t points;
+    uint32_t keyframe_interval;
+    float error_bound;
+    uint32_t reserved;
+};
+
+struct TrajectoryChunkHeader {
+    uint32_t type;
+    uint32_t frame;
+    uint64_t payload_bytes;
+};
+
+struct TrajectoryIndexEntry {
+    uint32_t frame;
+    uint32_t reserved;
+    uint64_t offset;
+};
+
+struct TrajectoryFooter {
+    uint64_t index_offset;
+    uint32_t keyframe_count;
+    // One past the last recorded frame number.
+    uint32_t frame_count;
+    char magic[8];
+};
+
+// Shared by the recorder and the reader so both reconstruct identically.
+class TrajectoryCodec {
+public:
+    void reset(uint32_t points, float error_bound);
+
+    // Encodes xyz (3 * points floats) and returns the chunk type used: a
+    // keyframe when asked for one, or when a delta would not fit. Deltas
+    // are encoded in blocks spread over pool when one is given.
+    TrajectoryChunkType encode(const float* xyz, bool keyframe,
+        std::vector<uint8_t>& payload, ThreadPool* pool = nullptr);
+
+    // Decodes one payload into xyz. Returns false on malformed input.
+    bool decode(TrajectoryChunkType type, const uint8_t* payload, size_t bytes, float* xyz);
+
+private:
+    bool encode_block(const float* xyz, size_t begin, size_t end, std::vector<uint8_t>& out);
+    void push_reconstruction();
+
+    uint32_t m_points;
+    float m_step;
+    int m_history;
+    std::vector<float> m_recon[2];
+    std::vector<float> m_next;
+    std::vector<std::vector<uint8_t> > m_blocks;
+};
+
+// Streams position frames to disk from a background thread. The caller
+// fills a queued buffer and hands it off; the encoding (spread over a
+// thread pool) and writing happen on the writer thread. When every queued
+// buffer is still waiting to be written, begin_frame() returns null and the
+// frame is dropped rather than blocking the simulation. A failed write
+// stops the recording; close() reports it.
+class TrajectoryRecorder {
+public:
+    TrajectoryRecorder();
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    bool open(const char* path, int points, float error_bound,
+        int keyframe_interval = 60, int queue_frames = 4);
+
+    // Writes everything still queued, then the keyframe index. Returns
+    // false, after saying why, if any write failed and the file is
+    // incomplete.
+    bool close();
+
+    // Frames handed in are numbered by permutation; they are written out
+    // in row-major order. Set before open().
+    void set_node_order(const NodePermutation& permutation) { m_permutation = permutation; }
+
+    bool is_open() const { return m_file != nullptr; }
+
+    // Returns a buffer of points positions (xyz + mass, like
+    // m_vbo[POSITION_*]) to fill for the given frame number, or null if
+    // the frame must be dropped. Frame numbers must increase from call to
+    // call.
+    Vec4f* begin_frame(uint32_t frame);
+    void end_frame();
+
+    uint32_t frames_written() const;
+    uint32_t frames_dropped() const;
+    uint64_t bytes_written() const;
+
+private:
+    void writer_main();
+    bool write_frame(const Vec4f* positions, uint32_t frame);
+
+    FILE* m_file;
+    TrajectoryFileHeader m_header;
+    std::thread m_writer;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::vector<Vec4f> > m_slots;
+    // Frame number each slot was filled for.
+    std::vector<uint32_t> m_slot_frames;
+    std::vector<int> m_free_slots;
+    std::deque<int> m_queued;
+    int m_filling;
+    bool m_quit;
+    bool m_write_failed;
+
+    NodePermutation m_permutation;
+
+    // Writer thread only.
+    std::unique_ptr<ThreadPool> m_pool;
+    TrajectoryCodec m_codec;
+    std::vector<float> m_xyz;
+    std::vector<uint8_t> m_payload;
+    std::vector<TrajectoryIndexEntry> m_index;
+    uint64_t m_offset;
+    // One past the last frame number written.
+    uint32_t m_next_frame;
+
+    uint32_t m_frames_written;
+    uint32_t m_frames_dropped;
+    uint64_t m_bytes_written;
+};
+
+// Random access to a recorded trajectory: seeks to the nearest keyframe
+// at or before the wanted frame and decodes forward from there.
+class TrajectoryReader {
+public:
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    uint32_t points() const { return m_header.points; }
+    uint32_t frame_count() const { return m_footer.frame_count; }
+    float error_bound() const { return m_header.error_bound; }
+
+    // Fills xyz with 3 * points() floats. Returns false if frame was
+    // dropped while recording, or the file is damaged.
+    bool read_frame(uint32_t frame, float* xyz);
+
+private:
+    bool read_next_chunk(float* xyz);
+
+    FILE* m_file;
+    TrajectoryFileHeader m_header;
+    TrajectoryFooter m_footer;
+    std::vector<TrajectoryIndexEntry> m_index;
+    TrajectoryCodec m_codec;
+    std::vector<uint8_t> m_payload;
+
+    // One past the frame of the last chunk read, so sequential reads
+    // don't reseek.
+    uint32_t m_next_frame;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+
+// Single-producer, single-consumer handoff of whole values without locks.
+// The writer fills write_buffer() and publishes it; the reader calls
+// update() to swap in the newest published value, if any, and reads it
+// through read_buffer(). The three buffers rotate through the writer, the
+// reader and a shared middle slot, so neither side ever waits and the
+// reader skips straight to the newest value when it falls behind.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_middle(1), m_write(0), m_read(2) {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Direct access for sizing the buffers before either side starts.
+    T& buffer(int index) { return m_buffers[index]; }
+
+    // Writer side.
+    T& write_buffer() { return m_buffers[m_write]; }
+    void publish() {
+        m_write = m_middle.exchange(m_write | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side. Returns true if a newer value was swapped in.
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        m_read = m_middle.exchange(m_read, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    const T& read_buffer() const { return m_buffers[m_read]; }
+
+private:
+    // The middle slot's index, with FRESH set while it holds a value the
+    // reader hasn't taken yet.
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    T m_buffers[3];
+    std::atomic<int> m_middle;
+    int m_write;
+    int m_read;
+};
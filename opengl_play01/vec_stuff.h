@@ -1,81 +1,88 @@
 #pragma once
 
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+// The vector types are plain trivially-copyable structs: copies are
+// memberwise, so arrays of them can go through memcpy and into GL buffers
+// as they are, and construction and the const operators are constexpr.
+//
+// Build with VEC4F_SIMD=1 to run Vec4f's arithmetic on SSE or NEON
+// registers (its operators are then no longer constexpr). Without it, or
+// on targets with neither, Vec4f is scalar like the others.
+#if defined(VEC4F_SIMD) && VEC4F_SIMD && \
+    (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define VEC4F_SSE 1
+#elif defined(VEC4F_SIMD) && VEC4F_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define VEC4F_NEON 1
+#endif
+
+#if defined(VEC4F_SSE)
+typedef __m128 Vec4fLanes;
+inline Vec4fLanes lanes_add(Vec4fLanes a, Vec4fLanes b) { return _mm_add_ps(a, b); }
+inline Vec4fLanes lanes_sub(Vec4fLanes a, Vec4fLanes b) { return _mm_sub_ps(a, b); }
+inline Vec4fLanes lanes_mul(Vec4fLanes a, float b) { return _mm_mul_ps(a, _mm_set1_ps(b)); }
+inline Vec4fLanes lanes_div(Vec4fLanes a, float b) { return _mm_div_ps(a, _mm_set1_ps(b)); }
+#elif defined(VEC4F_NEON)
+typedef float32x4_t Vec4fLanes;
+inline Vec4fLanes lanes_add(Vec4fLanes a, Vec4fLanes b) { return vaddq_f32(a, b); }
+inline Vec4fLanes lanes_sub(Vec4fLanes a, Vec4fLanes b) { return vsubq_f32(a, b); }
+inline Vec4fLanes lanes_mul(Vec4fLanes a, float b) { return vmulq_n_f32(a, b); }
+#if defined(__aarch64__)
+inline Vec4fLanes lanes_div(Vec4fLanes a, float b) { return vdivq_f32(a, vdupq_n_f32(b)); }
+#else
+inline Vec4fLanes lanes_div(Vec4fLanes a, float b) {
+    float lanes[4];
+    vst1q_f32(lanes, a);
+    for (int i = 0; i < 4; i++) {
+        lanes[i] /= b;
+    }
+    return vld1q_f32(lanes);
+}
+#endif
+#endif
+
 struct Vec3f {
 
     float x;
     float y;
     float z;
 
-    Vec3f(float x, float y, float z) : x(x), y(y), z(z) {
-    }
-
-    Vec3f() : Vec3f(0, 0, 0) {
-    }
-
-    Vec3f(const Vec3f& other) : Vec3f(other.x, other.y, other.z) {
+    constexpr Vec3f(float x, float y, float z) : x(x), y(y), z(z) {
     }
 
-    Vec3f& operator=(const Vec3f& rhs) {
-        if (this != &rhs) {
-            x = rhs.x;
-            y = rhs.y;
-            z = rhs.z;
-        }
-        return *this;
+    constexpr Vec3f() : x(0), y(0), z(0) {
     }
 
+    // Indexing goes through a table of member pointers rather than
+    // comparing i against each component.
     float operator[](int i) const {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-
-        assert(false);
-        return 0;
+        assert(i >= 0 && i < 3);
+        return this->*member(i);
     }
 
     float& operator[](int i) {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-
-        assert(false);
-        return x;
+        assert(i >= 0 && i < 3);
+        return this->*member(i);
     }
 
-    Vec3f operator+(const Vec3f& rhs) const {
-        Vec3f result = {
-            x + rhs.x,
-            y + rhs.y,
-            z + rhs.z
-        };
-        return result;
+    constexpr Vec3f operator+(const Vec3f& rhs) const {
+        return Vec3f(x + rhs.x, y + rhs.y, z + rhs.z);
     }
 
-    Vec3f operator-(const Vec3f& rhs) const {
-        Vec3f result = {
-            x - rhs.x,
-            y - rhs.y,
-            z - rhs.z
-        };
-        return result;
+    constexpr Vec3f operator-(const Vec3f& rhs) const {
+        return Vec3f(x - rhs.x, y - rhs.y, z - rhs.z);
     }
 
-    Vec3f operator*(float scalar) const {
-        Vec3f result = {
-            x * scalar,
-            y * scalar,
-            z * scalar
-        };
-        return result;
+    constexpr Vec3f operator*(float scalar) const {
+        return Vec3f(x * scalar, y * scalar, z * scalar);
     }
 
-    Vec3f operator/(float scalar) const {
-        Vec3f result = {
-            x / scalar,
-            y / scalar,
-            z / scalar
-        };
-        return result;
+    constexpr Vec3f operator/(float scalar) const {
+        return Vec3f(x / scalar, y / scalar, z / scalar);
     }
 
     Vec3f& operator+=(const Vec3f& rhs) {
@@ -106,7 +113,7 @@ struct Vec3f {
         return *this;
     }
 
-    float dot(const Vec3f& rhs) const {
+    constexpr float dot(const Vec3f& rhs) const {
         return x * rhs.x + y * rhs.y + z * rhs.z;
     }
 
@@ -119,100 +126,111 @@ struct Vec3f {
         return *this / len;
     }
 
-    Vec3f cross(const Vec3f& rhs) const {
-        Vec3f result(
+    constexpr Vec3f cross(const Vec3f& rhs) const {
+        return Vec3f(
             y * rhs.z - z * rhs.y,
             z * rhs.x - x * rhs.z,
             x * rhs.y - y * rhs.x
         );
-        return result;
+    }
+
+private:
+    static float Vec3f::* member(int i) {
+        static float Vec3f::* const members[] = { &Vec3f::x, &Vec3f::y, &Vec3f::z };
+        return members[i];
     }
 };
 
-struct Vec4f {
+// 16-byte aligned so the SIMD build can load it in one go; the size, and
+// so the layout of position arrays, is the same either way.
+struct alignas(16) Vec4f {
 
     float x;
     float y;
     float z;
     float w;
 
-    Vec4f(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {
-    }
-
-    Vec4f() : Vec4f(0, 0, 0, 0) {
-    }
-
-    Vec4f(const Vec4f& other) : Vec4f(other.x, other.y, other.z, other.w) {
+    constexpr Vec4f(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {
     }
 
-    Vec4f& operator=(const Vec4f& rhs) {
-        if (this != &rhs) {
-            x = rhs.x;
-            y = rhs.y;
-            z = rhs.z;
-            w = rhs.w;
-        }
-        return *this;
+    constexpr Vec4f() : x(0), y(0), z(0), w(0) {
     }
 
     float operator[](int i) const {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-        if (i == 3) return w;
-
-        assert(false);
-        return 0;
+        assert(i >= 0 && i < 4);
+        return this->*member(i);
     }
 
     float& operator[](int i) {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-        if (i == 3) return w;
-
-        assert(false);
-        return x;
+        assert(i >= 0 && i < 4);
+        return this->*member(i);
+    }
+
+#if defined(VEC4F_SSE) || defined(VEC4F_NEON)
+    Vec4fLanes lanes() const {
+#if defined(VEC4F_SSE)
+        return _mm_load_ps(&x);
+#else
+        return vld1q_f32(&x);
+#endif
+    }
+
+    static Vec4f from_lanes(Vec4fLanes lanes) {
+        Vec4f result;
+#if defined(VEC4F_SSE)
+        _mm_store_ps(&result.x, lanes);
+#else
+        vst1q_f32(&result.x, lanes);
+#endif
+        return result;
     }
 
     Vec4f operator+(const Vec4f& rhs) const {
-        Vec4f result = {
-            x + rhs.x,
-            y + rhs.y,
-            z + rhs.z,
-            w + rhs.w
-        };
-        return result;
+        return from_lanes(lanes_add(lanes(), rhs.lanes()));
     }
 
     Vec4f operator-(const Vec4f& rhs) const {
-        Vec4f result = {
-            x - rhs.x,
-            y - rhs.y,
-            z - rhs.z,
-            w - rhs.w
-        };
-        return result;
+        return from_lanes(lanes_sub(lanes(), rhs.lanes()));
     }
 
     Vec4f operator*(float scalar) const {
-        Vec4f result = {
-            x * scalar,
-            y * scalar,
-            z * scalar,
-            w * scalar
-        };
-        return result;
+        return from_lanes(lanes_mul(lanes(), scalar));
     }
 
     Vec4f operator/(float scalar) const {
-        Vec4f result = {
-            x / scalar,
-            y / scalar,
-            z / scalar,
-            w / scalar
-        };
-        return result;
+        return from_lanes(lanes_div(lanes(), scalar));
+    }
+
+    Vec4f& operator+=(const Vec4f& rhs) {
+        return *this = *this + rhs;
+    }
+
+    Vec4f& operator-=(const Vec4f& rhs) {
+        return *this = *this - rhs;
+    }
+
+    Vec4f& operator*=(double scalar) {
+        return *this = *this * (float)scalar;
+    }
+
+    Vec4f& operator/=(double scalar) {
+        return *this = *this / (float)scalar;
+    }
+#else
+    constexpr Vec4f operator+(const Vec4f& rhs) const {
+        return Vec4f(x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w);
+    }
+
+    constexpr Vec4f operator-(const Vec4f& rhs) const {
+        return Vec4f(x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w);
+    }
+
+    constexpr Vec4f operator*(float scalar) const {
+        return Vec4f(x * scalar, y * scalar, z * scalar, w * scalar);
+    }
+
+    constexpr Vec4f operator/(float scalar) const {
+        return Vec4f(x / scalar, y / scalar, z / scalar, w / scalar);
     }
 
     Vec4f& operator+=(const Vec4f& rhs) {
@@ -246,8 +264,9 @@ struct Vec4f {
         w /= scalar;
         return *this;
     }
+#endif
 
-    float dot(const Vec4f& rhs) const {
+    constexpr float dot(const Vec4f& rhs) const {
         return x * rhs.x + y * rhs.y + z * rhs.z + w * rhs.w;
     }
 
@@ -269,6 +288,12 @@ struct Vec4f {
     //     );
     //     return result;
     // }
+
+private:
+    static float Vec4f::* member(int i) {
+        static float Vec4f::* const members[] = { &Vec4f::x, &Vec4f::y, &Vec4f::z, &Vec4f::w };
+        return members[i];
+    }
 };
 
 struct Vec4i {
@@ -278,83 +303,36 @@ struct Vec4i {
     int z;
     int w;
 
-    Vec4i(int x, int y, int z, int w) : x(x), y(y), z(z), w(w) {
+    constexpr Vec4i(int x, int y, int z, int w) : x(x), y(y), z(z), w(w) {
     }
 
-    Vec4i() : Vec4i(0, 0, 0, 0) {
-    }
-
-    Vec4i(const Vec4i& other) : Vec4i(other.x, other.y, other.z, other.w) {
-    }
-
-    Vec4i& operator=(const Vec4i& rhs) {
-        if (this != &rhs) {
-            x = rhs.x;
-            y = rhs.y;
-            z = rhs.z;
-            w = rhs.w;
-        }
-        return *this;
+    constexpr Vec4i() : x(0), y(0), z(0), w(0) {
     }
 
     int operator[](int i) const {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-        if (i == 3) return w;
-
-        assert(false);
-        return 0;
+        assert(i >= 0 && i < 4);
+        return this->*member(i);
     }
 
     int& operator[](int i) {
-        if (i == 0) return x;
-        if (i == 1) return y;
-        if (i == 2) return z;
-        if (i == 3) return w;
-
-        assert(false);
-        return x;
-    }
-
-    Vec4i operator+(const Vec4i& rhs) const {
-        Vec4i result = {
-            x + rhs.x,
-            y + rhs.y,
-            z + rhs.z,
-            w + rhs.w
-        };
-        return result;
+        assert(i >= 0 && i < 4);
+        return this->*member(i);
     }
 
-    Vec4i operator-(const Vec4i& rhs) const {
-        Vec4i result = {
-            x - rhs.x,
-            y - rhs.y,
-            z - rhs.z,
-            w - rhs.w
-        };
-        return result;
+    constexpr Vec4i operator+(const Vec4i& rhs) const {
+        return Vec4i(x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w);
     }
 
-    Vec4i operator*(int scalar) const {
-        Vec4i result = {
-            x * scalar,
-            y * scalar,
-            z * scalar,
-            w * scalar
-        };
-        return result;
+    constexpr Vec4i operator-(const Vec4i& rhs) const {
+        return Vec4i(x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w);
     }
 
-    Vec4i operator/(int scalar) const {
-        Vec4i result = {
-            x / scalar,
-            y / scalar,
-            z / scalar,
-            w / scalar
-        };
-        return result;
+    constexpr Vec4i operator*(int scalar) const {
+        return Vec4i(x * scalar, y * scalar, z * scalar, w * scalar);
+    }
+
+    constexpr Vec4i operator/(int scalar) const {
+        return Vec4i(x / scalar, y / scalar, z / scalar, w / scalar);
     }
 
     Vec4i& operator+=(const Vec4i& rhs) {
@@ -411,4 +389,15 @@ struct Vec4i {
     //     );
     //     return result;
     // }
+
+private:
+    static int Vec4i::* member(int i) {
+        static int Vec4i::* const members[] = { &Vec4i::x, &Vec4i::y, &Vec4i::z, &Vec4i::w };
+        return members[i];
+    }
 };
+
+// GL buffers and checkpoints take arrays of these as raw bytes.
+static_assert(std::is_trivially_copyable<Vec3f>::value && sizeof(Vec3f) == 12, "Vec3f must be 3 packed floats");
+static_assert(std::is_trivially_copyable<Vec4f>::value && sizeof(Vec4f) == 16, "Vec4f must be 4 packed floats");
+static_assert(std::is_trivially_copyable<Vec4i>::value && sizeof(Vec4i) == 16, "Vec4i must be 4 packed ints");
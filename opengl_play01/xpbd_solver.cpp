@@ -0,0 +1,206 @@
+#include "xpbd_solver.h"
+
+#include <algorithm>
+
+// Constraints (or nodes) per parallel task. A colour of the 2048x2048
+// grid has about a million, so this still leaves plenty of tasks to steal.
+static const int items_per_task = 4096;
+
+// Calls func(begin, end) over [first, first + count) in items_per_task
+// slices, on pool when there is one.
+template <typename Func>
+static void run_slices(ThreadPool* pool, int first, int count, Func func) {
+    if (!pool) {
+        func(first, first + count);
+        return;
+    }
+
+    int tasks = (count + items_per_task - 1) / items_per_task;
+    pool->parallel_for(tasks, [&](int task) {
+        int begin = first + task * items_per_task;
+        func(begin, std::min(begin + items_per_task, first + count));
+    });
+}
+
+void build_distance_constraints(const SpringTopology& topology,
+    std::vector<DistanceConstraint>& constraints) {
+
+    constraints.clear();
+
+    for (int n = 0; n < topology.nodes(); n++) {
+        for (int s = topology.offsets[n]; s < topology.offsets[n + 1]; s++) {
+            int other = topology.neighbours[s];
+            // Take a two-way spring from its lower-numbered end only
+            if (other < n && topology.has_spring(other, n)) {
+                continue;
+            }
+
+            DistanceConstraint constraint;
+            constraint.a = n;
+            constraint.b = other;
+            constraint.rest_length = topology.coeffs[s].rest_length;
+            constraint.compliance = 1.0f / topology.coeffs[s].stiffness;
+            constraints.push_back(constraint);
+        }
+    }
+}
+
+int color_constraints(const std::vector<DistanceConstraint>& constraints, int node_count,
+    std::vector<int>& colors) {
+
+    // Bit i of used[n] is set once a colour-i constraint touches node n.
+    // Beyond 32 colours everything goes into the last one, which is then
+    // no longer safe to run in parallel; no spring set here gets close.
+    std::vector<unsigned> used(node_count, 0);
+    int color_count = 0;
+
+    colors.resize(constraints.size());
+    for (size_t i = 0; i < constraints.size(); i++) {
+        const DistanceConstraint& constraint = constraints[i];
+        unsigned taken = used[constraint.a] | used[constraint.b];
+        int color = 0;
+        while (color < 31 && (taken & (1u << color))) {
+            color++;
+        }
+
+        assert(!(taken & (1u << color)));
+        colors[i] = color;
+        used[constraint.a] |= 1u << color;
+        used[constraint.b] |= 1u << color;
+        color_count = std::max(color_count, color + 1);
+    }
+
+    return color_count;
+}
+
+XpbdSolver::XpbdSolver(int points_x, int points_y)
+    : m_points_x(points_x), m_points_y(points_y), m_iteration_index(0), m_time(0),
+      m_iterations(8), m_pool(nullptr) {
+
+    int total = points_total();
+    m_positions.resize(total);
+    m_velocities.resize(total);
+    m_start_positions.resize(total);
+    m_inv_mass.resize(total);
+
+    reset();
+}
+
+void XpbdSolver::reset() {
+    init_cloth_grid(m_points_x, m_points_y, m_positions.data(), m_velocities.data(), nullptr);
+
+    SpringTopology topology;
+    build_cloth_topology(m_points_x, m_points_y, m_params, topology);
+    build_cloth_pins(m_points_x, m_points_y, m_params, m_pins);
+    compute_inverse_masses(m_pins, m_positions.data(), points_total(), m_inv_mass);
+
+    // A constraint between two pins can never move either, so drop it
+    std::vector<DistanceConstraint> constraints;
+    std::vector<int> colors;
+    build_distance_constraints(topology, constraints);
+    constraints.erase(std::remove_if(constraints.begin(), constraints.end(),
+        [&](const DistanceConstraint& constraint) {
+            return m_inv_mass[constraint.a] + m_inv_mass[constraint.b] == 0.0f;
+        }), constraints.end());
+    int color_count = color_constraints(constraints, points_total(), colors);
+
+    // Counting sort by colour, keeping each colour in node order
+    m_color_offsets.assign(color_count + 1, 0);
+    for (int color : colors) {
+        m_color_offsets[color + 1]++;
+    }
+    for (int c = 0; c < color_count; c++) {
+        m_color_offsets[c + 1] += m_color_offsets[c];
+    }
+
+    std::vector<int> next(m_color_offsets.begin(), m_color_offsets.end() - 1);
+    m_constraints.resize(constraints.size());
+    for (size_t i = 0; i < constraints.size(); i++) {
+        m_constraints[next[colors[i]]++] = constraints[i];
+    }
+    m_lambda.resize(m_constraints.size());
+
+    m_iteration_index = 0;
+    m_time = 0;
+}
+
+void XpbdSolver::project(int begin, int end, float dt) {
+    float inv_dt2 = 1.0f / (dt * dt);
+
+    for (int i = begin; i < end; i++) {
+        const DistanceConstraint& constraint = m_constraints[i];
+        float wa = m_inv_mass[constraint.a];
+        float wb = m_inv_mass[constraint.b];
+
+        Vec4f& pa = m_positions[constraint.a];
+        Vec4f& pb = m_positions[constraint.b];
+        Vec3f d(pa.x - pb.x, pa.y - pb.y, pa.z - pb.z);
+        float x = d.length();
+        if (x == 0.0f) {
+            continue;
+        }
+
+        float alpha = constraint.compliance * inv_dt2;
+        float C = x - constraint.rest_length;
+        float dlambda = (-C - alpha * m_lambda[i]) / (wa + wb + alpha);
+        m_lambda[i] += dlambda;
+
+        Vec3f correction = d * (dlambda / x);
+        pa += Vec4f(correction.x * wa, correction.y * wa, correction.z * wa, 0.0f);
+        pb -= Vec4f(correction.x * wb, correction.y * wb, correction.z * wb, 0.0f);
+    }
+}
+
+void XpbdSolver::step() {
+    const float t = m_params.t;
+    const float c = m_params.c;
+    const Vec3f gravity(0.0f, GRAVITY_Y, 0.0f);
+
+    run_slices(m_pool, 0, points_total(), [&](int begin, int end) {
+        m_pins.for_free_spans(begin, end, [&](int span_begin, int span_end) {
+            for (int n = span_begin; n < span_end; n++) {
+                Vec4f& p = m_positions[n];
+                m_start_positions[n] = Vec3f(p.x, p.y, p.z);
+
+                // Damping taken implicitly so large steps can't overshoot it
+                Vec3f& v = m_velocities[n];
+                v = (v + gravity * t) / (1.0f + c * t * m_inv_mass[n]);
+                p = Vec4f(p.x + v.x * t, p.y + v.y * t, p.z + v.z * t, p.w);
+            }
+        });
+    });
+
+    // Swaying pins move before the constraints see them
+    m_time += t;
+    if (m_pins.animated) {
+        m_pins.move(m_time, m_positions.data());
+    }
+
+    std::fill(m_lambda.begin(), m_lambda.end(), 0.0f);
+
+    for (int iteration = 0; iteration < m_iterations; iteration++) {
+        for (int color = 0; color < color_count(); color++) {
+            int first = m_color_offsets[color];
+            run_slices(m_pool, first, m_color_offsets[color + 1] - first, [&](int begin, int end) {
+                project(begin, end, t);
+            });
+        }
+    }
+
+    run_slices(m_pool, 0, points_total(), [&](int begin, int end) {
+        m_pins.for_free_spans(begin, end, [&](int span_begin, int span_end) {
+            for (int n = span_begin; n < span_end; n++) {
+                const Vec4f& p = m_positions[n];
+                m_velocities[n] = (Vec3f(p.x, p.y, p.z) - m_start_positions[n]) / t;
+            }
+        });
+    });
+
+    m_iteration_index++;
+}
+
+void XpbdSolver::step(int iterations) {
+    for (int i = iterations; i != 0; --i) {
+        step();
+    }
+}
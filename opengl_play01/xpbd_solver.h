@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+
+#include <vector>
+
+#include "spring_mass_solver.h"
+#include "spring_topology.h"
+#include "thread_pool.h"
+#include "vec_stuff.h"
+
+// A spring as a position constraint: |x_a - x_b| = rest_length, softened
+// by compliance (1 / stiffness).
+struct DistanceConstraint {
+    int a;
+    int b;
+    float rest_length;
+    float compliance;
+};
+
+// One constraint per connected node pair of topology; a spring listed in
+// both directions becomes a single constraint.
+void build_distance_constraints(const SpringTopology& topology,
+    std::vector<DistanceConstraint>& constraints);
+
+// Greedy edge colouring: colors[i] is the colour of constraints[i], and
+// no two constraints of one colour touch the same node. Returns the
+// number of colours; the 4-connected grid needs 4, shear and bend
+// springs a few more.
+int color_constraints(const std::vector<DistanceConstraint>& constraints, int node_count,
+    std::vector<int>& colors);
+
+// Extended position-based dynamics. Each step of params.t moves the nodes
+// ballistically (gravity, then damping c applied implicitly), then
+// projects every distance constraint iterations times and takes the
+// velocity from how far each node moved. Constraints are processed one
+// colour at a time; within a colour no two share a node, so a colour is
+// split across the thread pool with no atomics. Stays stable at any
+// stiffness and step, converging more slowly as they grow. Node
+// numbering and buffer layout are SpringMassSolver's, row-major, and
+// likewise only the free spans of pins() are integrated.
+class XpbdSolver {
+public:
+    XpbdSolver(int points_x, int points_y);
+
+    void reset();
+
+    void step();
+    void step(int iterations);
+
+    // Null runs on the calling thread.
+    void set_thread_pool(ThreadPool* pool) { m_pool = pool; }
+
+    // Constraint passes per step.
+    void set_iterations(int iterations) { m_iterations = iterations; }
+    int iterations() const { return m_iterations; }
+
+    int points_x() const { return m_points_x; }
+    int points_y() const { return m_points_y; }
+    int points_total() const { return m_points_x * m_points_y; }
+
+    unsigned iteration_index() const { return m_iteration_index; }
+
+    int constraint_count() const { return (int)m_constraints.size(); }
+    int color_count() const { return (int)m_color_offsets.size() - 1; }
+
+    SpringParams& params() { return m_params; }
+    const SpringParams& params() const { return m_params; }
+
+    const Vec4f* positions() const { return m_positions.data(); }
+    const Vec3f* velocities() const { return m_velocities.data(); }
+    const PinSet& pins() const { return m_pins; }
+
+private:
+    void project(int begin, int end, float dt);
+
+    int m_points_x;
+    int m_points_y;
+    unsigned m_iteration_index;
+    double m_time;
+    int m_iterations;
+    SpringParams m_params;
+    ThreadPool* m_pool;
+
+    std::vector<Vec4f> m_positions;
+    std::vector<Vec3f> m_velocities;
+    std::vector<Vec3f> m_start_positions;
+    PinSet m_pins;
+    // 1 / mass, 0 for pinned nodes.
+    std::vector<float> m_inv_mass;
+
+    // Sorted by colour, leaving out any joining two pins; colour i is
+    // [m_color_offsets[i], m_color_offsets[i + 1]).
+    std::vector<DistanceConstraint> m_constraints;
+    std::vector<int> m_color_offsets;
+    // Accumulated Lagrange multiplier of each constraint this step.
+    std::vector<float> m_lambda;
+};
@@ -2,7 +2,10 @@
 
 layout (location = 0) in vec3 position;
 
+// Maps the cloth into clip space; startup() sets it from the grid size
+uniform float scale = 0.03;
+
 void main(void)
 {
-    gl_Position = vec4(position * 0.03, 1.0);
+    gl_Position = vec4(position * scale, 1.0);
 }
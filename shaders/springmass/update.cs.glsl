@@ -0,0 +1,153 @@
+#version 430 core
+
+// Compute version of update.vs.glsl. Each workgroup owns a TILE x TILE
+// block of the grid and loads it plus a HALO-wide border into shared
+// memory, then runs up to FUSED_STEPS substeps there without going back
+// to global memory. Every substep makes the border's outer REACH ring
+// stale, so HALO = REACH * FUSED_STEPS leaves the tile itself exact.
+//
+// TILE, REACH, FUSED_STEPS and HALO are #defined by the application, and
+// PERMUTED when the nodes aren't numbered row-major.
+
+#define REGION (TILE + 2 * HALO)
+
+layout (local_size_x = TILE, local_size_y = TILE) in;
+
+// Same buffers as the transform-feedback path. Velocities are packed
+// vec3s, so they are read as floats.
+layout (std430, binding = 0) readonly buffer PositionIn { vec4 position_in[]; };
+layout (std430, binding = 1) readonly buffer VelocityIn { float velocity_in[]; };
+layout (std430, binding = 2) writeonly buffer PositionOut { vec4 position_out[]; };
+layout (std430, binding = 3) writeonly buffer VelocityOut { float velocity_out[]; };
+
+// The spring graph in CSR form, as in update.vs.glsl
+layout (std430, binding = 4) readonly buffer Offsets { int offsets[]; };
+layout (std430, binding = 5) readonly buffer Neighbours { int neighbours[]; };
+layout (std430, binding = 6) readonly buffer Springs { vec2 springs[]; };
+layout (std430, binding = 7) readonly buffer InvMass { float inv_mass[]; };
+
+#ifdef PERMUTED
+// Node number to row-major grid index and back
+layout (std430, binding = 8) readonly buffer ToGrid { int to_grid[]; };
+layout (std430, binding = 9) readonly buffer FromGrid { int from_grid[]; };
+#endif
+
+uniform ivec2 grid_size;
+
+// Substeps to run this dispatch, at most FUSED_STEPS
+uniform int steps = FUSED_STEPS;
+
+uniform float t = 0.07;
+uniform float c = 2.8;
+
+// Nodes from here on are pinned: they are numbered last, never updated
+// and never written. Swaying ones are uploaded between dispatches.
+uniform int active_end;
+
+const vec3 gravity = vec3(0.0, -0.08, 0.0);
+
+// Positions are ping-ponged between substeps; velocities are only read
+// by their own node, so they're updated in place. A node index of -1
+// marks a slot outside the grid.
+shared vec4 s_position[2][REGION * REGION];
+shared vec3 s_velocity[REGION * REGION];
+shared float s_inv_mass[REGION * REGION];
+shared int s_node[REGION * REGION];
+
+int node_index(ivec2 cell)
+{
+    int grid = cell.x + cell.y * grid_size.x;
+#ifdef PERMUTED
+    return from_grid[grid];
+#else
+    return grid;
+#endif
+}
+
+ivec2 node_cell(int node)
+{
+#ifdef PERMUTED
+    int grid = to_grid[node];
+#else
+    int grid = node;
+#endif
+    return ivec2(grid % grid_size.x, grid / grid_size.x);
+}
+
+void main(void)
+{
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - HALO;
+    int first_slot = int(gl_LocalInvocationIndex);
+    const int slot_stride = TILE * TILE;
+
+    for (int slot = first_slot; slot < REGION * REGION; slot += slot_stride) {
+        ivec2 cell = origin + ivec2(slot % REGION, slot / REGION);
+        int n = -1;
+        if (all(greaterThanEqual(cell, ivec2(0))) && all(lessThan(cell, grid_size))) {
+            n = node_index(cell);
+            s_position[0][slot] = position_in[n];
+            s_velocity[slot] = vec3(velocity_in[n * 3], velocity_in[n * 3 + 1], velocity_in[n * 3 + 2]);
+            s_inv_mass[slot] = inv_mass[n];
+        }
+        s_node[slot] = n;
+    }
+
+    barrier();
+
+    for (int step = 0; step < steps; step++) {
+        int src = step & 1;
+
+        for (int slot = first_slot; slot < REGION * REGION; slot += slot_stride) {
+            int n = s_node[slot];
+            if (n < 0) {
+                continue;
+            }
+            if (n >= active_end) {
+                s_position[src ^ 1][slot] = s_position[src][slot];
+                continue;
+            }
+
+            vec3 p = s_position[src][slot].xyz;
+            float m = s_position[src][slot].w;
+            vec3 u = s_velocity[slot];
+            vec3 F = gravity * m - c * u;
+
+            int first = offsets[n];
+            int last = offsets[n + 1];
+
+            for (int i = first; i < last; i++) {
+                // Springs reaching out of the loaded region only happen
+                // in the stale border, whose results are never written
+                ivec2 local = node_cell(neighbours[i]) - origin;
+                if (any(lessThan(local, ivec2(0))) || any(greaterThanEqual(local, ivec2(REGION)))) {
+                    continue;
+                }
+
+                vec3 q = s_position[src][local.x + local.y * REGION].xyz;
+                vec3 d = q - p;
+                float x = length(d);
+                F += -springs[i].y * (springs[i].x - x) * normalize(d);
+            }
+
+            vec3 a = F * s_inv_mass[slot];
+            vec3 s = clamp(u * t + 0.5 * a * t * t, vec3(-25.0), vec3(25.0));
+
+            s_position[src ^ 1][slot] = vec4(p + s, m);
+            s_velocity[slot] = u + a * t;
+        }
+
+        barrier();
+    }
+
+    // Only the tile itself is exact after the fused substeps
+    ivec2 local = ivec2(gl_LocalInvocationID.xy) + HALO;
+    int slot = local.x + local.y * REGION;
+    int n = s_node[slot];
+    if (n >= 0 && n < active_end) {
+        vec3 v = s_velocity[slot];
+        position_out[n] = s_position[steps & 1][slot];
+        velocity_out[n * 3] = v.x;
+        velocity_out[n * 3 + 1] = v.y;
+        velocity_out[n * 3 + 2] = v.z;
+    }
+}
@@ -5,13 +5,20 @@
 layout (location = 0) in vec4 position_mass;
 // This is the current velocity of the vertex
 layout (location = 1) in vec3 velocity;
-// This is our connection vector
-layout (location = 2) in ivec4 connection;
 
 // This is a TBO that will be bound to the same buffer as the
 // position_mass input attribute
 uniform samplerBuffer tex_position;
 
+// The spring graph in CSR form: the springs of vertex n are entries
+// offsets[n] to offsets[n + 1] of the neighbour and spring TBOs
+uniform isamplerBuffer tex_offsets;
+uniform isamplerBuffer tex_neighbours;
+// Rest length in x, stiffness in y, one texel per spring
+uniform samplerBuffer tex_springs;
+// 1 / mass of each vertex, 0 for a pinned one
+uniform samplerBuffer tex_inv_mass;
+
 // The outputs of the vertex shader are the same as the inputs
 out vec4 tf_position_mass;
 out vec3 tf_velocity;
@@ -19,45 +26,34 @@ out vec3 tf_velocity;
 // A uniform to hold the timestep. The application can update this.
 uniform float t = 0.07;
 
-// The global spring constant
-uniform float k = 7.1;
-
 // Gravity
 const vec3 gravity = vec3(0.0, -0.08, 0.0);
 
 // Global damping constant
 uniform float c = 2.8;
 
-// Spring resting length
-uniform float rest_length = 0.88;
-
 void main(void)
 {
     vec3 p = position_mass.xyz;    // p can be our position
     float m = position_mass.w;     // m is the mass of our vertex
     vec3 u = velocity;             // u is the initial velocity
     vec3 F = gravity * m - c * u;  // F is the force on the mass
-    bool fixed_node = true;        // Becomes false when force is applied
 
-    for (int i = 0; i < 4; i++) {
-        if (connection[i] != -1) {
-            // q is the position of the other vertex
-            vec3 q = texelFetch(tex_position, connection[i]).xyz;
-            vec3 d = q - p;
-            float x = length(d);
-            F += -k * (rest_length - x) * normalize(d);
-            fixed_node = false;
-        }
-    }
+    int first = texelFetch(tex_offsets, gl_VertexID).x;
+    int last = texelFetch(tex_offsets, gl_VertexID + 1).x;
 
-    // If this is a fixed node, reset force to zero
-    if (fixed_node)
-    {
-        F = vec3(0.0);
+    for (int i = first; i < last; i++) {
+        // q is the position of the other vertex
+        vec3 q = texelFetch(tex_position, texelFetch(tex_neighbours, i).x).xyz;
+        vec2 spring = texelFetch(tex_springs, i).xy;
+        vec3 d = q - p;
+        float x = length(d);
+        F += -spring.y * (spring.x - x) * normalize(d);
     }
 
-    // Accelleration due to force
-    vec3 a = F / m;
+    // Accelleration due to force; pinned vertices are numbered after the
+    // drawn range, and have an inverse mass of 0 besides
+    vec3 a = F * texelFetch(tex_inv_mass, gl_VertexID).x;
 
     // Displacement
     vec3 s = u * t + 0.5 * a * t * t;